@@ -0,0 +1,72 @@
+// ==============================================================================
+/**
+ * alloc-new.cc
+ *
+ * C++ allocation operators for either allocator.  Linking (or preloading) this
+ * alongside bf-alloc or sf-alloc routes `new` and `delete` to them directly,
+ * and in particular routes the C++14 _sized_ `delete` operators to
+ * `free_sized()`.  That spares sf-alloc only the check of whether a block lies
+ * in its heap; the block's run is still looked up to return the block to it.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+extern "C" {
+#include "alloc.h"
+}
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block for `new`, retrying through the new-handler on failure as
+ * the standard requires.  A zero-sized request still yields a unique block, so
+ * it is allocated as one byte, and the matching sized `delete` (which is given
+ * 0) maps to the same size class.
+ *
+ * \param size The number of bytes requested.
+ * \return     A pointer to the new block.
+ */
+static void* allocate (std::size_t size) {
+
+  if (size == 0) {
+    size = 1;
+  }
+
+  void* block_ptr;
+  while ((block_ptr = std::malloc(size)) == nullptr) {
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+
+  return block_ptr;
+
+} // allocate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+// THE REPLACEABLE OPERATORS
+
+void* operator new   (std::size_t size) { return allocate(size); }
+void* operator new[] (std::size_t size) { return allocate(size); }
+
+void operator delete   (void* ptr) noexcept { std::free(ptr); }
+void operator delete[] (void* ptr) noexcept { std::free(ptr); }
+
+void operator delete   (void* ptr, std::size_t size) noexcept { free_sized(ptr, size); }
+void operator delete[] (void* ptr, std::size_t size) noexcept { free_sized(ptr, size); }
+// ==============================================================================
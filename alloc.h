@@ -0,0 +1,425 @@
+// ==============================================================================
+/**
+ * alloc.h
+ *
+ * Extensions to the standard allocation interface, provided by both bf-alloc
+ * and sf-alloc.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_ALLOC_H)
+#define _ALLOC_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES
+
+/** A region of memory from which blocks are bump-allocated (bf-alloc only). */
+typedef struct arena arena_s;
+
+/** A point in an arena's allocation history, to which it can be rolled back. */
+typedef struct arena_mark {
+
+  /** The chunk that was current at the mark. */
+  void*    chunk;
+
+  /** The next free byte in that chunk at the mark. */
+  intptr_t cursor;
+
+} arena_mark_s;
+
+/** A pool of fixed-size objects (sf-alloc only). */
+typedef struct object_pool object_pool_s;
+
+/** A snapshot of an allocator's global statistics. */
+typedef struct alloc_stats {
+
+  /** The number of blocks ever allocated and freed. */
+  size_t allocations;
+  size_t frees;
+
+  /** The bytes ever requested, and the bytes ever handed out to satisfy them. */
+  size_t requested_bytes;
+  size_t allocated_bytes;
+
+  /** The blocks currently allocated in the heap, and the bytes they span. */
+  size_t live_blocks;
+  size_t live_bytes;
+
+  /** The blocks currently free in the heap, and the bytes they span. */
+  size_t free_blocks;
+  size_t free_bytes;
+
+  /** The bytes of the heap taken by headers, descriptors, and run tails. */
+  size_t overhead_bytes;
+
+  /** The bytes of the heap region that have been used so far. */
+  size_t heap_bytes;
+
+  /** The bytes of the heap that have been handed back to the kernel. */
+  size_t released_bytes;
+
+  /** The large blocks mapped outside of the heap, and the bytes they span. */
+  size_t large_mappings;
+  size_t large_bytes;
+
+  /** The bytes of freed large mappings kept for reuse. */
+  size_t cached_bytes;
+
+} alloc_stats_s;
+
+/** A snapshot of the statistics of one size class. */
+typedef struct alloc_class_stats {
+
+  /** The size of the blocks in the class. */
+  size_t block_size;
+
+  /** The number of blocks of the class ever allocated and freed. */
+  size_t allocations;
+  size_t frees;
+
+  /** The number of runs held by the class. */
+  size_t runs;
+
+  /** The number of blocks of the class currently allocated and free. */
+  size_t live_blocks;
+  size_t free_blocks;
+
+} alloc_class_stats_s;
+
+/** The number of power-of-2 buckets in a fragmentation report's histogram. */
+#define FRAG_BUCKETS 48
+
+/** A fragmentation report for the heap (bf-alloc only). */
+typedef struct alloc_frag {
+
+  /** The number of free blocks, the bytes they span, and the largest of them. */
+  size_t free_blocks;
+  size_t free_bytes;
+  size_t largest_free;
+
+  /** External fragmentation: 1 - `largest_free` / `free_bytes`, in thousandths. */
+  size_t fragmentation_permille;
+
+  /** The number of allocated blocks, and the bytes they span. */
+  size_t live_blocks;
+  size_t live_bytes;
+
+  /** The bytes taken by block headers, and by alignment padding between blocks. */
+  size_t header_bytes;
+  size_t padding_bytes;
+
+  /** The bytes of the heap used so far, and the bytes still left to bump into. */
+  size_t heap_bytes;
+  size_t unused_bytes;
+
+  /** The number of free blocks, and their bytes, of sizes in [2^i, 2^(i+1)). */
+  size_t histogram_blocks[FRAG_BUCKETS];
+  size_t histogram_bytes[FRAG_BUCKETS];
+
+} alloc_frag_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `n` blocks of `size` bytes each, amortizing the cost of finding the
+ * blocks across the whole batch.
+ *
+ * \param size The number of bytes in each block.
+ * \param n    The number of blocks to allocate.
+ * \param ptrs An array of at least `n` entries, into which pointers to the new
+ *             blocks are stored.
+ * \return     The number of blocks allocated, which is less than `n` only if
+ *             the heap is exhausted.  Those blocks are in `ptrs[0]` onwards.
+ */
+size_t malloc_batch (size_t size, size_t n, void** ptrs);
+
+/**
+ * Deallocate `n` blocks at once.  Entries that are `NULL` are skipped.
+ *
+ * \param ptrs The blocks to deallocate.
+ * \param n    The number of entries in `ptrs`.
+ */
+void free_batch (void** ptrs, size_t n);
+
+/**
+ * Deallocate a block whose size is known to the caller (as in C23).  In
+ * sf-alloc, a large block is then recognized by its size alone, skipping the
+ * check of whether it lies in the heap; any other block is still returned
+ * through its run's descriptor, whose class must match `size` or the process
+ * dies.  bf-alloc checks `size` only if compiled with `DEBUG_ALLOC`.
+ *
+ * \param ptr  The block to deallocate; may be `NULL`.
+ * \param size The size originally requested for the block.
+ */
+void free_sized (void* ptr, size_t size);
+
+/**
+ * Deallocate a block whose alignment and size are known to the caller (as in
+ * C23).  Neither allocator over-aligns blocks, so `alignment` must be no more
+ * than the fundamental alignment of 16 bytes.
+ *
+ * \param ptr       The block to deallocate; may be `NULL`.
+ * \param alignment The alignment originally requested for the block.
+ * \param size      The size originally requested for the block.
+ */
+void free_aligned_sized (void* ptr, size_t alignment, size_t size);
+// ==============================================================================
+
+
+
+// ==============================================================================
+// STATISTICS
+
+/**
+ * Take a snapshot of the allocator's global statistics.
+ *
+ * \param stats Where to store the snapshot.
+ */
+void malloc_get_stats (alloc_stats_s* stats);
+
+/**
+ * Take a snapshot of the statistics of each of the allocator's size classes,
+ * smallest first.
+ *
+ * \param classes Where to store the snapshots.
+ * \param n       The number of snapshots that fit at `classes`.
+ * \return        The number of size classes, which may be more than `n` (in
+ *                 which case only the first `n` are stored), or 0 if the
+ *                 allocator has none.
+ */
+size_t malloc_get_class_stats (alloc_class_stats_s* classes, size_t n);
+// ==============================================================================
+
+
+
+// ==============================================================================
+// FRAGMENTATION (bf-alloc only)
+
+/**
+ * Walk every block of the heap, free and allocated, and report how fragmented
+ * it is.
+ *
+ * \param frag Where to store the report.
+ */
+void malloc_get_fragmentation (alloc_frag_s* frag);
+
+/**
+ * Write a fragmentation report to a file descriptor, followed by a coarse map
+ * of the used heap in which each character summarizes a span of addresses:
+ * `#` mostly allocated, `.` mostly free, `+` mixed, and ` ` only padding.
+ *
+ * \param fd The file descriptor.
+ */
+void malloc_fragmentation_dump (int fd);
+// ==============================================================================
+
+
+
+// ==============================================================================
+// ARENAS (bf-alloc only)
+
+/**
+ * Create an arena.  Its memory is carved from the heap in chunks, and blocks
+ * are then allocated from the current chunk by pointer bumping.  Blocks are
+ * never freed individually; instead, the arena is rolled back or reset.
+ *
+ * \param chunk_size The size of each chunk, or 0 for a default size.
+ * \return           The new arena, or `NULL` if the heap is exhausted.
+ */
+arena_s* arena_create (size_t chunk_size);
+
+/**
+ * Allocate a block from an arena.
+ *
+ * \param arena The arena.
+ * \param size  The number of bytes to allocate.
+ * \return      A pointer to the block, or `NULL` if `size` is 0 or the heap is
+ *               exhausted.
+ */
+void* arena_alloc (arena_s* arena, size_t size);
+
+/**
+ * Record the current point in an arena's allocations.
+ *
+ * \param arena The arena.
+ * \return      A mark that can be passed to `arena_release_to_mark()`.
+ */
+arena_mark_s arena_mark (arena_s* arena);
+
+/**
+ * Free every block allocated from an arena since a mark was taken, returning
+ * any chunks added since then to the heap.  Marks taken after `mark` become
+ * invalid.
+ *
+ * \param arena The arena.
+ * \param mark  A mark previously returned by `arena_mark()` for this arena.
+ */
+void arena_release_to_mark (arena_s* arena, arena_mark_s mark);
+
+/**
+ * Free every block allocated from an arena, keeping only its first chunk.
+ *
+ * \param arena The arena.
+ */
+void arena_reset (arena_s* arena);
+
+/**
+ * Free an arena and all of its chunks.
+ *
+ * \param arena The arena.
+ */
+void arena_destroy (arena_s* arena);
+// ==============================================================================
+
+
+
+// ==============================================================================
+// PERSISTENCE (bf-alloc only)
+
+/**
+ * Find the offset of a block from the start of the heap.  Unlike its address,
+ * the offset stays the same if the heap is reopened from its file at another
+ * address (see `persist` in allocconf.h), and in every process sharing the
+ * heap (see `shared`), so data kept in such a heap should link its blocks by
+ * offsets.
+ *
+ * \param ptr The block; may be `NULL`.
+ * \return    Its offset, which is never 0, or 0 if `ptr` is `NULL`.
+ */
+size_t malloc_offset (const void* ptr);
+
+/**
+ * Find a block from its offset from the start of the heap.
+ *
+ * \param offset An offset returned by `malloc_offset()`, or 0.
+ * \return       The block, or `NULL` if `offset` is 0.
+ */
+void* malloc_at_offset (size_t offset);
+
+/**
+ * Record a root block, from which the application can find all of its data in
+ * the heap again once the heap is reopened.  It is kept in the heap itself.
+ * Any block that cannot be found from the root, and is not freed, is leaked
+ * for good; that includes blocks that the C library allocates for itself.
+ *
+ * \param ptr The root block, or `NULL` for none.
+ */
+void malloc_set_root (void* ptr);
+
+/**
+ * Find the root block last recorded, possibly by an earlier process.
+ *
+ * \return The root block, or `NULL` if there is none (as in a new heap).
+ */
+void* malloc_get_root ();
+
+/**
+ * Flush the used heap to its file, returning once it is on the disk.  The
+ * allocator's own bookkeeping is flushed as it changes if `persist_sync:on` is
+ * set; the blocks' contents are flushed only here, and when the heap is closed
+ * at exit.  Does nothing unless the heap is kept in a file.
+ */
+void malloc_sync ();
+
+/**
+ * Find the descriptor of a heap shared through a memfd (see `shared` in
+ * allocconf.h), so that it can be passed to another process.  That process
+ * then joins the heap by naming the descriptor in its own settings; a child
+ * forked after the heap was created shares it already.  Blocks are handed
+ * between processes as offsets from `malloc_offset()`.
+ *
+ * \return The descriptor, or -1 if the heap is not in a memfd.
+ */
+int malloc_shared_fd ();
+// ==============================================================================
+
+
+
+// ==============================================================================
+// CACHE LINES (sf-alloc only)
+
+/** The size of a cache line, assumed to be the same on every supported machine. */
+#define ALLOC_CACHE_LINE 64
+
+/**
+ * Allocate a block that shares no cache line with any other block, so that
+ * writes to it never falsely share a line with another block (such as a counter
+ * belonging to another thread).  To give every block whole lines, set
+ * `cacheline:on` in `SFALLOC_CONF` instead.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the block, to be freed by `free()`, or `NULL` if
+ *              `size` is 0 or the heap is exhausted.  The block is larger
+ *              than `size` asked for, so it must not be given to
+ *              `free_sized()` with `size`; only with `size` rounded up to
+ *              whole lines.
+ */
+void* malloc_cacheline (size_t size);
+// ==============================================================================
+
+
+
+// ==============================================================================
+// OBJECT POOLS (sf-alloc only)
+
+/**
+ * Create a pool of fixed-size objects, with heap pages and a free list of its
+ * own.
+ *
+ * \param obj_size The size of each object.
+ * \param align    The alignment of each object: a power of 2 no greater than
+ *                  the page size, or 0 for the default alignment.
+ * \return         The new pool, or `NULL` if the arguments are invalid or the
+ *                  heap is full.
+ */
+object_pool_s* pool_create (size_t obj_size, size_t align);
+
+/**
+ * Allocate an object from a pool.
+ *
+ * \param pool The pool.
+ * \return     A pointer to the object, or `NULL` if the heap is full.
+ */
+void* pool_alloc (object_pool_s* pool);
+
+/**
+ * Return an object to the pool from which it was allocated.
+ *
+ * \param pool The pool.
+ * \param ptr  The object; may be `NULL`.
+ */
+void pool_free (object_pool_s* pool, void* ptr);
+
+/**
+ * Destroy a pool, freeing all of its objects and returning its pages to the
+ * heap.
+ *
+ * \param pool The pool.
+ */
+void pool_destroy (object_pool_s* pool);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _ALLOC_H
+// ==============================================================================
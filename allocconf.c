@@ -0,0 +1,252 @@
+// ==============================================================================
+/**
+ * allocconf.c
+ *
+ * Parse allocator settings from an environment variable without allocating.
+ * The variable's value is scanned in place, one setting at a time.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "allocconf.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The most characters of a bad setting repeated in its warning. */
+#define MAX_QUOTED 128
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Does a piece of the value spell a given word?
+ *
+ * \param text   The start of the piece.
+ * \param length Its length.
+ * \param word   The word.
+ * \return       `true` if they match.
+ */
+static bool spells (const char* text, size_t length, const char* word) {
+
+  return strlen(word) == length && strncmp(text, word, length) == 0;
+
+} // spells ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Parse a size: decimal digits, optionally followed by `K`, `M`, or `G`.
+ *
+ * \param text   The start of the size.
+ * \param length Its length.
+ * \param size   Where to store the size.
+ * \return       Whether it was a valid size.
+ */
+static bool parse_size (const char* text, size_t length, size_t* size) {
+
+  size_t value  = 0;
+  size_t digits = 0;
+  while (digits < length && text[digits] >= '0' && text[digits] <= '9') {
+    size_t next = value * 10 + (text[digits] - '0');
+    if (next / 10 != value) {
+      return false;
+    }
+    value   = next;
+    digits += 1;
+  }
+  if (digits == 0) {
+    return false;
+  }
+
+  unsigned int shift = 0;
+  if (digits + 1 == length) {
+    switch (text[digits]) {
+    case 'k': case 'K': shift = 10; break;
+    case 'm': case 'M': shift = 20; break;
+    case 'g': case 'G': shift = 30; break;
+    default:            return false;
+    }
+  } else if (digits != length) {
+    return false;
+  }
+  if (shift != 0 && value > (SIZE_MAX >> shift)) {
+    return false;
+  }
+
+  *size = value << shift;
+  return true;
+
+} // parse_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Parse a switch: `on` or `off`.
+ *
+ * \param text   The start of the switch.
+ * \param length Its length.
+ * \param on     Where to store whether it is on.
+ * \return       Whether it was a valid switch.
+ */
+static bool parse_switch (const char* text, size_t length, bool* on) {
+
+  if (spells(text, length, "on")) {
+    *on = true;
+    return true;
+  }
+  if (spells(text, length, "off")) {
+    *on = false;
+    return true;
+  }
+  return false;
+
+} // parse_switch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Apply one `name:value` setting.
+ *
+ * \return Whether the setting was valid and accepted.
+ */
+static bool apply (const char* setting, size_t length, unsigned int accepted, alloc_conf_s* conf) {
+
+  const char* colon = memchr(setting, ':', length);
+  if (colon == NULL) {
+    return false;
+  }
+  size_t      name_length  = colon - setting;
+  const char* value        = colon + 1;
+  size_t      value_length = length - name_length - 1;
+
+  if (spells(setting, name_length, "heap_size") && (accepted & ALLOCCONF_HEAP_SIZE)) {
+    return parse_size(value, value_length, &conf->heap_size) && conf->heap_size > 0;
+  }
+  if (spells(setting, name_length, "mmap_threshold") && (accepted & ALLOCCONF_MMAP_THRESHOLD)) {
+    return parse_size(value, value_length, &conf->mmap_threshold);
+  }
+  if (spells(setting, name_length, "thp") && (accepted & ALLOCCONF_THP)) {
+    bool on;
+    if (!parse_switch(value, value_length, &on)) {
+      return false;
+    }
+    conf->thp = on ? ALLOC_THP_ON : ALLOC_THP_OFF;
+    return true;
+  }
+  if (spells(setting, name_length, "stats") && (accepted & ALLOCCONF_STATS)) {
+    return parse_switch(value, value_length, &conf->stats);
+  }
+  if (spells(setting, name_length, "guard_rate") && (accepted & ALLOCCONF_GUARD_RATE)) {
+    return parse_size(value, value_length, &conf->guard_rate);
+  }
+  if (spells(setting, name_length, "cacheline") && (accepted & ALLOCCONF_CACHELINE)) {
+    return parse_switch(value, value_length, &conf->cacheline);
+  }
+  if (spells(setting, name_length, "color") && (accepted & ALLOCCONF_COLOR)) {
+    return parse_switch(value, value_length, &conf->color);
+  }
+  if (spells(setting, name_length, "numa") && (accepted & ALLOCCONF_NUMA)) {
+    size_t node;
+    if (spells(value, value_length, "off")) {
+      conf->numa_node = ALLOC_NUMA_OFF;
+    } else if (spells(value, value_length, "local")) {
+      conf->numa_node = ALLOC_NUMA_LOCAL;
+    } else if (parse_size(value, value_length, &node) && node < INT_MAX) {
+      conf->numa_node = (int)node;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (spells(setting, name_length, "persist") && (accepted & ALLOCCONF_PERSIST)) {
+    if (value_length == 0 || value_length >= sizeof(conf->persist_path)) {
+      return false;
+    }
+    memcpy(conf->persist_path, value, value_length);
+    conf->persist_path[value_length] = '\0';
+    return true;
+  }
+  if (spells(setting, name_length, "shared") && (accepted & ALLOCCONF_SHARED)) {
+    if (value_length == 0 || value_length >= sizeof(conf->shared_name)) {
+      return false;
+    }
+    memcpy(conf->shared_name, value, value_length);
+    conf->shared_name[value_length] = '\0';
+    return true;
+  }
+  if (spells(setting, name_length, "persist_sync") && (accepted & ALLOCCONF_PERSIST)) {
+    return parse_switch(value, value_length, &conf->persist_sync);
+  }
+  if (spells(setting, name_length, "fit") && (accepted & ALLOCCONF_FIT)) {
+    if (spells(value, value_length, "best")) {
+      conf->fit = ALLOC_FIT_BEST;
+      return true;
+    }
+    if (spells(value, value_length, "first")) {
+      conf->fit = ALLOC_FIT_FIRST;
+      return true;
+    }
+  }
+  return false;
+
+} // apply ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void allocconf_load (const char* variable, unsigned int accepted, alloc_conf_s* conf) {
+
+  const char* text = getenv(variable);
+  if (text == NULL) {
+    return;
+  }
+
+  while (*text != '\0') {
+
+    const char* comma  = strchr(text, ',');
+    size_t      length = (comma != NULL) ? (size_t)(comma - text) : strlen(text);
+    if (length > 0 && !apply(text, length, accepted, conf)) {
+
+      // Quote the setting, truncated, in a warning.
+      char   quoted[MAX_QUOTED + 1];
+      size_t quoted_length = (length < MAX_QUOTED) ? length : MAX_QUOTED;
+      memcpy(quoted, text, quoted_length);
+      quoted[quoted_length] = '\0';
+      safe_write(STDERR_FILENO, variable);
+      safe_write(STDERR_FILENO, ": Ignoring setting \"");
+      safe_write(STDERR_FILENO, quoted);
+      safe_write(STDERR_FILENO, "\"\n");
+
+    }
+    text += length;
+    if (*text == ',') {
+      text += 1;
+    }
+
+  }
+
+} // allocconf_load ()
+// ==============================================================================
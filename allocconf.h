@@ -0,0 +1,158 @@
+// ==============================================================================
+/**
+ * allocconf.h
+ *
+ * Runtime configuration of the allocators from an environment variable, in the
+ * style of `MALLOC_CONF`: a comma-separated list of `name:value` settings, for
+ * example
+ *
+ *   BFALLOC_CONF=heap_size:8G,mmap_threshold:1M,thp:on,stats:on
+ *
+ * The settings are:
+ *
+ *   heap_size:<size>       The address space reserved for the heap.
+ *   mmap_threshold:<size>  Requests larger than this are mapped on their own;
+ *                          0 for none but those too large for the heap to
+ *                          hold.  In sf-alloc, that is anything larger than
+ *                          its largest size class, which is also the most the
+ *                          threshold can be; bf-alloc holds anything it has
+ *                          room for.
+ *   thp:on|off             Ask for transparent huge pages for the heap, or ask
+ *                          that it have none.  Left alone if not given.
+ *   stats:on|off           Print the allocator's statistics at exit.
+ *   fit:best|first         How to choose among free blocks that fit.
+ *   guard_rate:<n>         If built with `GUARD_POOL`, the mean number of
+ *                          allocations between guarded samples; 0 for none.
+ *   cacheline:on|off       Give every block whole cache lines of its own, so
+ *                          that no two blocks share a line.
+ *   color:on|off           Stagger the first block of each run by a rotating
+ *                          number of cache lines.  On by default.
+ *   numa:<node>|local|off  If built with `NUMA_AWARE`, the NUMA node on which
+ *                          to place the heap and large blocks, or the node of
+ *                          the thread that first allocates.  Off by default.
+ *   persist:<path>         If built with `PERSISTENT_HEAP`, keep the heap in
+ *                          this file, reopening it if it exists; see
+ *                          heapfile.h.  The path cannot contain a comma.
+ *                          Every block that the process allocates lands in
+ *                          the file, the C library's own (such as stdio's
+ *                          buffers) included, and outlives the process unless
+ *                          freed.
+ *   persist_sync:on|off    Flush each change to the heap's own bookkeeping
+ *                          to the file before going on, so that a crash of
+ *                          the machine leaves the heap usable.  Off by
+ *                          default.
+ *   shared:<name>          If built with `PERSISTENT_HEAP`, share the heap with
+ *                          other processes: a POSIX shared memory object, as
+ *                          `/<name>`; `memfd` for a new memfd; or the number
+ *                          of an inherited descriptor of one.  Takes the place
+ *                          of `persist`.
+ *
+ * Sizes are in bytes, or with a `K`, `M`, or `G` suffix.  Each allocator reads
+ * the settings that apply to it once, in `init()`, and the hot paths then read
+ * them from a plain structure.  Parsing never allocates: a setting that cannot
+ * be used is reported to `stderr` and ignored.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_ALLOCCONF_H)
+#define _ALLOCCONF_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES
+
+/** Whether to ask for transparent huge pages. */
+typedef enum alloc_thp {
+
+  ALLOC_THP_DEFAULT = 0,
+  ALLOC_THP_ON,
+  ALLOC_THP_OFF
+
+} alloc_thp_e;
+
+/** How to choose among free blocks that fit. */
+typedef enum alloc_fit {
+
+  ALLOC_FIT_BEST = 0,
+  ALLOC_FIT_FIRST
+
+} alloc_fit_e;
+
+/** The settings. */
+typedef struct alloc_conf {
+
+  size_t      heap_size;
+  size_t      mmap_threshold;
+  alloc_thp_e thp;
+  bool        stats;
+  alloc_fit_e fit;
+  size_t      guard_rate;
+  bool        cacheline;
+  bool        color;
+  int         numa_node;
+  bool        persist_sync;
+  char        persist_path[PATH_MAX];
+  char        shared_name[NAME_MAX + 1];
+
+} alloc_conf_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The settings, as bits, so that each allocator can say which it accepts. */
+#define ALLOCCONF_HEAP_SIZE      0x01
+#define ALLOCCONF_MMAP_THRESHOLD 0x02
+#define ALLOCCONF_THP            0x04
+#define ALLOCCONF_STATS          0x08
+#define ALLOCCONF_FIT            0x10
+#define ALLOCCONF_GUARD_RATE     0x20
+#define ALLOCCONF_CACHELINE      0x40
+#define ALLOCCONF_COLOR          0x80
+#define ALLOCCONF_NUMA           0x100
+#define ALLOCCONF_PERSIST        0x200
+#define ALLOCCONF_SHARED         0x400
+
+/** The special values of `numa_node`. */
+#define ALLOC_NUMA_OFF   -1
+#define ALLOC_NUMA_LOCAL -2
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Override settings with those given by an environment variable, if it is set.
+ *
+ * \param variable The name of the environment variable.
+ * \param accepted The settings that the allocator accepts, as `ALLOCCONF_*`
+ *                 bits; any others are reported and ignored.
+ * \param conf     The settings, already filled in with their defaults.
+ */
+void allocconf_load (const char* variable, unsigned int accepted, alloc_conf_s* conf);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _ALLOCCONF_H
+// ==============================================================================
@@ -0,0 +1,430 @@
+// ==============================================================================
+/**
+ * alloctrace.c
+ *
+ * A recorder of the allocation stream.  Each thread claims a single-producer,
+ * single-consumer ring on its first event; the ring's storage is mapped
+ * directly, not allocated.  The thread advances the ring's head, and only the
+ * flusher thread advances its tail, so neither ever takes a lock.  When the
+ * thread exits, it gives up its ring, which the next thread to need one takes
+ * over, along with whatever events the flusher has yet to drain from it.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "alloctrace.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** A thread's ring of events. */
+typedef struct ring {
+
+  /** The number of events ever appended; written only by the owning thread. */
+  uint64_t            head __attribute__((aligned(64)));
+
+  /** The number of events ever drained; written only by the flusher. */
+  uint64_t            tail __attribute__((aligned(64)));
+
+  /** The number of events dropped because the ring was full. */
+  uint64_t            dropped;
+
+  /** Whether the ring's thread has exited, leaving the ring for another. */
+  bool                released;
+
+  /** The events, `ALLOCTRACE_RING_EVENTS` of them. */
+  alloctrace_event_s* events;
+
+} ring_s;
+
+/** Whether tracing is on, off, or not yet decided. */
+typedef enum trace_state {
+
+  TRACE_UNDECIDED = 0,
+  TRACE_ON,
+  TRACE_OFF
+
+} trace_state_e;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS AND FUNCTIONS
+
+/** The environment variable that names the trace file. */
+#define TRACE_FILE_VARIABLE "ALLOCTRACE_FILE"
+
+/** How long the flusher sleeps when it finds nothing to drain, in nanoseconds. */
+#define FLUSH_INTERVAL_NS (10 * 1000 * 1000)
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The depth of traced calls within traced calls on this thread. */
+__thread unsigned int alloctrace_nesting = 0;
+
+/** This thread's ring, its kernel ID, and whether it has given up on a ring. */
+static __thread ring_s*  my_ring      = NULL;
+static __thread uint32_t my_thread_id = 0;
+static __thread bool     ringless     = false;
+
+/** Whether tracing is on. */
+static trace_state_e state = TRACE_UNDECIDED;
+
+/** The rings; the first `rings_claimed` of them belong to threads, or did. */
+static ring_s   rings[ALLOCTRACE_MAX_THREADS];
+static unsigned rings_claimed = 0;
+
+/** The key whose destructor gives up a thread's ring when the thread exits. */
+static pthread_key_t ring_key;
+
+/** The number of events lost because their thread had no ring. */
+static uint64_t ringless_events = 0;
+
+/** The trace file. */
+static int trace_fd = -1;
+
+/** The flusher thread, and whether it has been asked to stop. */
+static pthread_t flusher;
+static bool      flusher_running = false;
+static bool      flusher_stop    = false;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Give up an exiting thread's ring, so that another thread can take it over.
+ * Any events that the thread records from here on, as later destructors free
+ * their data, are lost and counted.
+ *
+ * \param ring The thread's ring.
+ */
+static void release_ring (void* ring) {
+
+  my_ring  = NULL;
+  ringless = true;
+  __atomic_store_n(&((ring_s*)ring)->released, true, __ATOMIC_RELEASE);
+
+} // release_ring ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Decide, once, whether to trace, according to the environment.  The trace
+ * file is opened and its header written here; the flusher is started later,
+ * once the process is far enough along to create threads.
+ */
+static void decide () {
+
+  const char* path = getenv(TRACE_FILE_VARIABLE);
+  if (path == NULL || path[0] == '\0') {
+    state = TRACE_OFF;
+    return;
+  }
+
+  trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (trace_fd == -1) {
+    safe_debug("alloctrace: Could not open trace file", 0);
+    state = TRACE_OFF;
+    return;
+  }
+
+  alloctrace_header_s header;
+  memcpy(header.magic, ALLOCTRACE_MAGIC, sizeof(header.magic));
+  header.version    = ALLOCTRACE_VERSION;
+  header.event_size = sizeof(alloctrace_event_s);
+  write(trace_fd, &header, sizeof(header));
+  pthread_key_create(&ring_key, release_ring);
+  state = TRACE_ON;
+
+} // decide ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Make a ring the calling thread's, to be given up when the thread exits.
+ * Registering it may itself allocate, so the calls it makes go unrecorded.
+ *
+ * \param ring The ring.
+ * \return     The ring.
+ */
+static ring_s* register_ring (ring_s* ring) {
+
+  my_ring             = ring;
+  alloctrace_nesting += 1;
+  pthread_setspecific(ring_key, ring);
+  alloctrace_nesting -= 1;
+  return ring;
+
+} // register_ring ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Claim a ring for the calling thread: one given up by an exited thread if
+ * there is one, and otherwise a new one, mapping its storage.  The ring is
+ * registered with `ring_key`, so that it is given up in turn.
+ *
+ * \return The ring, or `NULL` if there are no rings left or no memory.
+ */
+static ring_s* claim_ring () {
+
+  my_thread_id = (uint32_t)syscall(SYS_gettid);
+
+  // Take over a ring given up by an exited thread, appending after its events.
+  unsigned claimed = __atomic_load_n(&rings_claimed, __ATOMIC_ACQUIRE);
+  if (claimed > ALLOCTRACE_MAX_THREADS) {
+    claimed = ALLOCTRACE_MAX_THREADS;
+  }
+  for (unsigned i = 0; i < claimed; i += 1) {
+    bool released = true;
+    if (__atomic_load_n(&rings[i].released, __ATOMIC_RELAXED) &&
+	__atomic_compare_exchange_n(&rings[i].released, &released, false, false,
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return register_ring(&rings[i]);
+    }
+  }
+
+  unsigned index = __atomic_fetch_add(&rings_claimed, 1, __ATOMIC_ACQ_REL);
+  if (index >= ALLOCTRACE_MAX_THREADS) {
+    return NULL;
+  }
+
+  ring_s* ring   = &rings[index];
+  void*   events = mmap(NULL,
+			ALLOCTRACE_RING_EVENTS * sizeof(alloctrace_event_s),
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0);
+  if (events == MAP_FAILED) {
+    return NULL;
+  }
+
+  // Publish the storage last, so that the flusher never sees a ring without it.
+  __atomic_store_n(&ring->events, (alloctrace_event_s*)events, __ATOMIC_RELEASE);
+  return register_ring(ring);
+
+} // claim_ring ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record an event in the calling thread's ring, if tracing is on.  If the ring
+ * is full, the event is dropped rather than waiting for the flusher.
+ *
+ * \param op      The kind of event.
+ * \param ptr     The block returned or freed.
+ * \param size    The number of bytes requested.
+ * \param old_ptr For `realloc()`, the block passed in.
+ */
+void alloctrace_record (alloctrace_op_e op, void* ptr, size_t size, void* old_ptr) {
+
+  if (state != TRACE_ON) {
+    if (state == TRACE_OFF) {
+      return;
+    }
+    decide();
+    if (state == TRACE_OFF) {
+      return;
+    }
+  }
+
+  ring_s* ring = my_ring;
+  if (ring == NULL) {
+    if (!ringless) {
+      ring = claim_ring();
+    }
+    if (ring == NULL) {
+      ringless = true;
+      __atomic_fetch_add(&ringless_events, 1, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+
+  uint64_t head = ring->head;
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ALLOCTRACE_RING_EVENTS) {
+    ring->dropped += 1;
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  alloctrace_event_s* event = &ring->events[head % ALLOCTRACE_RING_EVENTS];
+  event->timestamp = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  event->ptr       = (uintptr_t)ptr;
+  event->old_ptr   = (uintptr_t)old_ptr;
+  event->size      = size;
+  event->thread    = my_thread_id;
+  event->op        = op;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+} // alloctrace_record ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write out whatever events each ring holds, straight from the ring's storage.
+ *
+ * \return The number of events written.
+ */
+static uint64_t drain () {
+
+  uint64_t written = 0;
+  unsigned claimed = __atomic_load_n(&rings_claimed, __ATOMIC_ACQUIRE);
+  if (claimed > ALLOCTRACE_MAX_THREADS) {
+    claimed = ALLOCTRACE_MAX_THREADS;
+  }
+
+  for (unsigned i = 0; i < claimed; i += 1) {
+
+    ring_s*             ring   = &rings[i];
+    alloctrace_event_s* events = __atomic_load_n(&ring->events, __ATOMIC_ACQUIRE);
+    if (events == NULL) {
+      continue;
+    }
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    // The pending events may wrap around the end of the ring.
+    while (tail < head) {
+      uint64_t start = tail % ALLOCTRACE_RING_EVENTS;
+      uint64_t count = head - tail;
+      if (start + count > ALLOCTRACE_RING_EVENTS) {
+	count = ALLOCTRACE_RING_EVENTS - start;
+      }
+      write(trace_fd, &events[start], count * sizeof(alloctrace_event_s));
+      tail    += count;
+      written += count;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  }
+
+  return written;
+
+} // drain ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * The body of the flusher thread: drain the rings until asked to stop, napping
+ * whenever they are empty.
+ *
+ * \param arg Unused.
+ * \return    `NULL`.
+ */
+static void* flush_loop (void* arg) {
+
+  (void)arg;
+  alloctrace_nesting = 1;  // the flusher's own allocations, if any, go unrecorded
+  while (!__atomic_load_n(&flusher_stop, __ATOMIC_ACQUIRE)) {
+    if (drain() == 0) {
+      struct timespec nap = { 0, FLUSH_INTERVAL_NS };
+      nanosleep(&nap, NULL);
+    }
+  }
+  return NULL;
+
+} // flush_loop ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Start the flusher once the process is initialized, if tracing is on.
+ */
+static void __attribute__((constructor)) alloctrace_start () {
+
+  if (state == TRACE_UNDECIDED) {
+    decide();
+  }
+  if (state != TRACE_ON) {
+    return;
+  }
+
+  alloctrace_nesting += 1;
+  flusher_running = (pthread_create(&flusher, NULL, flush_loop, NULL) == 0);
+  alloctrace_nesting -= 1;
+  if (!flusher_running) {
+    safe_debug("alloctrace: Could not start flusher; events will be written at exit", 0);
+  }
+
+} // alloctrace_start ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Stop tracing: stop the background thread, drain every ring, and close the
+ * trace file.
+ */
+void __attribute__((destructor)) alloctrace_stop () {
+
+  if (state != TRACE_ON) {
+    return;
+  }
+
+  if (flusher_running) {
+    __atomic_store_n(&flusher_stop, true, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+    flusher_running = false;
+  }
+  state = TRACE_OFF;
+  drain();
+
+  uint64_t dropped = 0;
+  for (unsigned i = 0; i < ALLOCTRACE_MAX_THREADS; i += 1) {
+    dropped += rings[i].dropped;
+  }
+  if (dropped != 0) {
+    safe_debug("alloctrace: Events dropped because a ring was full", 1, dropped);
+  }
+  if (ringless_events != 0) {
+    safe_debug("alloctrace: Events lost because their thread had no ring", 1, ringless_events);
+  }
+  close(trace_fd);
+  trace_fd = -1;
+
+} // alloctrace_stop ()
+// ==============================================================================
@@ -0,0 +1,161 @@
+// ==============================================================================
+/**
+ * alloctrace.h
+ *
+ * A recorder of the allocation stream.  Each call to `malloc()`, `calloc()`,
+ * `realloc()`, or `free()` appends a fixed-size binary event to a ring buffer
+ * owned by the calling thread, and a background thread drains the rings into a
+ * trace file with plain `write()`.  Nothing here allocates from the heap, and
+ * the recording threads never wait: if a ring is full, its event is dropped
+ * (and counted).  A thread's ring outlives it, and goes to the next thread
+ * that needs one.
+ *
+ * Recording is compiled into the allocators only if `ALLOC_TRACE` is defined,
+ * and happens only if the environment variable `ALLOCTRACE_FILE` names the
+ * trace file when the process starts.
+ *
+ * The trace file is an `alloctrace_header_s` followed by events.  Events from
+ * different threads are interleaved in chunks, not in timestamp order.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_ALLOCTRACE_H)
+#define _ALLOCTRACE_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** The kinds of event. */
+typedef enum alloctrace_op {
+
+  ALLOCTRACE_MALLOC  = 1,
+  ALLOCTRACE_CALLOC  = 2,
+  ALLOCTRACE_REALLOC = 3,
+  ALLOCTRACE_FREE    = 4
+
+} alloctrace_op_e;
+
+/** One event. */
+typedef struct alloctrace_event {
+
+  /** When the call returned, in nanoseconds of `CLOCK_MONOTONIC`. */
+  uint64_t timestamp;
+
+  /** The block returned, or for `free()`, the block freed. */
+  uint64_t ptr;
+
+  /** For `realloc()`, the block passed in; otherwise 0. */
+  uint64_t old_ptr;
+
+  /** The number of bytes requested; 0 for `free()`. */
+  uint64_t size;
+
+  /** The kernel's ID of the calling thread. */
+  uint32_t thread;
+
+  /** The kind of event, an `alloctrace_op_e`. */
+  uint32_t op;
+
+} alloctrace_event_s;
+
+/** The header at the start of a trace file. */
+typedef struct alloctrace_header {
+
+  /** `ALLOCTRACE_MAGIC`, unterminated. */
+  char     magic[8];
+
+  /** `ALLOCTRACE_VERSION`. */
+  uint32_t version;
+
+  /** The size of each event, `sizeof(alloctrace_event_s)`. */
+  uint32_t event_size;
+
+} alloctrace_header_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+#define ALLOCTRACE_MAGIC   "ALLOCTRC"
+#define ALLOCTRACE_VERSION 1
+
+/** The number of events that each thread's ring can hold. */
+#define ALLOCTRACE_RING_EVENTS 16384
+
+/** The most threads whose events are recorded at once; an exited thread's ring is reused. */
+#define ALLOCTRACE_MAX_THREADS 256
+
+/**
+ * Hooks for the allocators (or, if disabled, nothing).  `ALLOCTRACE()` records
+ * an event unless it comes from within another traced call, which brackets its
+ * own inner calls with `ALLOCTRACE_NEST()` and `ALLOCTRACE_UNNEST()`.
+ */
+#if defined (ALLOC_TRACE)
+#define ALLOCTRACE(op,ptr,size,old_ptr)					\
+  do {									\
+    if (alloctrace_nesting == 0) {					\
+      alloctrace_record((op), (ptr), (size), (old_ptr));		\
+    }									\
+  } while (0)
+#define ALLOCTRACE_NEST()   (alloctrace_nesting += 1)
+#define ALLOCTRACE_UNNEST() (alloctrace_nesting -= 1)
+#else
+#define ALLOCTRACE(op,ptr,size,old_ptr)
+#define ALLOCTRACE_NEST()
+#define ALLOCTRACE_UNNEST()
+#endif /* ALLOC_TRACE */
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The depth of traced calls within traced calls on this thread. */
+extern __thread unsigned int alloctrace_nesting;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record an event in the calling thread's ring, if tracing is on.
+ *
+ * \param op      The kind of event.
+ * \param ptr     The block returned or freed.
+ * \param size    The number of bytes requested.
+ * \param old_ptr For `realloc()`, the block passed in.
+ */
+void alloctrace_record (alloctrace_op_e op, void* ptr, size_t size, void* old_ptr);
+
+/**
+ * Stop tracing: stop the background thread, drain every ring, and close the
+ * trace file.  Called automatically at exit.
+ */
+void alloctrace_stop (void);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _ALLOCTRACE_H
+// ==============================================================================
@@ -0,0 +1,197 @@
+// ==============================================================================
+/**
+ * bench.c
+ *
+ * Common support for the allocator benchmarks: timing, hardware counters, a
+ * small random number generator that never calls into the allocator, and a
+ * common CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+double bench_now (void) {
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+
+} // bench_now ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int bench_counter_open (void) {
+
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type           = PERF_TYPE_HARDWARE;
+  attr.size           = sizeof(attr);
+  attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.inherit        = 1;  // count the threads it goes on to create, too
+
+  // There is no glibc wrapper for this system call.
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+} // bench_counter_open ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void bench_counter_start (int fd) {
+
+  if (fd != -1) {
+    ioctl(fd, PERF_EVENT_IOC_RESET,  0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+} // bench_counter_start ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+uint64_t bench_counter_stop (int fd) {
+
+  uint64_t count;
+  if (fd == -1) {
+    return BENCH_NO_COUNT;
+  }
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+    return BENCH_NO_COUNT;
+  }
+  return count;
+
+} // bench_counter_stop ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+long bench_peak_rss_kb (void) {
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+
+} // bench_peak_rss_kb ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* bench_scratch (size_t size) {
+
+  void* space = mmap(NULL,
+		     size,
+		     PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS,
+		     -1,
+		     0);
+  if (space == MAP_FAILED) {
+    perror("bench_scratch(): mmap");
+    exit(1);
+  }
+  return space;
+
+} // bench_scratch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+uint64_t bench_random (uint64_t* state) {
+
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545f4914f6cdd1dULL;
+
+} // bench_random ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** The lock that serializes calls into the allocator from multiple threads. */
+static pthread_mutex_t serial_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void* bench_serial_malloc (size_t size) {
+
+  pthread_mutex_lock(&serial_lock);
+  void* block = malloc(size);
+  pthread_mutex_unlock(&serial_lock);
+  return block;
+
+} // bench_serial_malloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void bench_serial_free (void* ptr) {
+
+  pthread_mutex_lock(&serial_lock);
+  free(ptr);
+  pthread_mutex_unlock(&serial_lock);
+
+} // bench_serial_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void bench_report (const char* benchmark, const char* config, uint64_t ops,
+		   double seconds, uint64_t misses) {
+
+  static bool header_written = false;
+  if (!header_written && getenv("BENCH_NO_HEADER") == NULL) {
+    printf("benchmark,allocator,config,ops,seconds,ops_per_sec,peak_rss_kb,misses_per_op\n");
+  }
+  header_written = true;
+
+  const char* allocator = getenv("BENCH_ALLOCATOR");
+  printf("%s,%s,%s,%lu,%.6f,%.0f,%ld,",
+	 benchmark, allocator != NULL ? allocator : "unlabeled", config,
+	 (unsigned long)ops, seconds, seconds > 0 ? ops / seconds : 0.0,
+	 bench_peak_rss_kb());
+  if (misses == BENCH_NO_COUNT) {
+    printf("n/a\n");
+  } else {
+    printf("%.3f\n", ops > 0 ? (double)misses / ops : 0.0);
+  }
+  fflush(stdout);
+
+} // bench_report ()
+// ==============================================================================
@@ -0,0 +1,136 @@
+// ==============================================================================
+/**
+ * bench.h
+ *
+ * Common support for the allocator benchmarks: timing, hardware counters, a
+ * small random number generator that never calls into the allocator, and a
+ * common CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_BENCH_H)
+#define _BENCH_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The value reported for a hardware counter that could not be opened. */
+#define BENCH_NO_COUNT UINT64_MAX
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Read a monotonic clock.
+ *
+ * \return The current time, in seconds.
+ */
+double bench_now (void);
+
+/**
+ * Open a counter of last-level cache misses for the calling thread and any
+ * threads it creates after the counter is opened.
+ *
+ * \return A file descriptor for the counter, or -1 if hardware counters are
+ *         unavailable (e.g., in a container or VM without a PMU).
+ */
+int bench_counter_open (void);
+
+/**
+ * Reset and start a counter.
+ *
+ * \param fd The counter, as returned by `bench_counter_open()`; may be -1.
+ */
+void bench_counter_start (int fd);
+
+/**
+ * Stop a counter and read its value.
+ *
+ * \param fd The counter, as returned by `bench_counter_open()`; may be -1.
+ * \return   The number of events counted, or `BENCH_NO_COUNT`.
+ */
+uint64_t bench_counter_stop (int fd);
+
+/**
+ * Find the peak resident set size of the process.
+ *
+ * \return The peak RSS, in kilobytes.
+ */
+long bench_peak_rss_kb (void);
+
+/**
+ * Allocate zeroed scratch space for a benchmark's own bookkeeping directly
+ * from the kernel, so that it does not disturb the allocator under test.
+ *
+ * \param size The number of bytes needed.
+ * \return     The scratch space.  Failure is fatal.
+ */
+void* bench_scratch (size_t size);
+
+/**
+ * Generate a pseudo-random number (_xorshift64*_).
+ *
+ * \param state The generator's state, which must be seeded with a non-zero
+ *              value.
+ * \return      The next pseudo-random number.
+ */
+uint64_t bench_random (uint64_t* state);
+
+/**
+ * Allocate a block while holding a lock shared by all threads.  Neither of the
+ * allocators is thread-safe, so multithreaded benchmarks serialize their calls
+ * into the allocator (for every allocator, to keep the comparison fair) while
+ * still using the blocks concurrently.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     The block.
+ */
+void* bench_serial_malloc (size_t size);
+
+/**
+ * Free a block while holding the lock used by `bench_serial_malloc()`.
+ *
+ * \param ptr The block.
+ */
+void bench_serial_free (void* ptr);
+
+/**
+ * Write one row of the suite's common CSV report to `stdout`: the benchmark,
+ * the allocator (from the `BENCH_ALLOCATOR` environment variable), the
+ * benchmark's configuration, operations, seconds, operations per second, peak
+ * RSS in kilobytes, and cache misses per operation.  Unless the environment
+ * variable `BENCH_NO_HEADER` is set, the column names are written first.
+ *
+ * \param benchmark The name of the benchmark.
+ * \param config    A short description of its parameters.
+ * \param ops       The number of operations performed.
+ * \param seconds   The time they took.
+ * \param misses    The cache misses counted, or `BENCH_NO_COUNT`.
+ */
+void bench_report (const char* benchmark, const char* config, uint64_t ops,
+		   double seconds, uint64_t misses);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _BENCH_H
+// ==============================================================================
@@ -0,0 +1,131 @@
+// ==============================================================================
+/**
+ * cache-scratch.c
+ *
+ * The Hoard cache-scratch and cache-thrash benchmarks, which detect allocators
+ * that cause false sharing.  Each thread repeatedly allocates a small object,
+ * writes to it many times, and frees it.
+ *
+ * - In _thrash_ mode, that is all: an allocator that hands out neighboring
+ *   blocks to different threads makes them fight over cache lines.
+ * - In _scratch_ mode, the main thread first allocates one object per thread
+ *   and passes it to that thread, which frees it before starting; an
+ *   allocator that reuses those blocks for other threads causes the sharing.
+ *
+ * The threads run concurrently, but their calls into the allocator are
+ * serialized by `bench_serial_malloc()` and `bench_serial_free()`, since
+ * neither allocator is thread-safe.  The writes, which are what the benchmark
+ * measures, are not serialized.
+ *
+ * sf-alloc packs these objects into 16 byte blocks, four to a cache line, so
+ * both modes suffer from false sharing under it unless every block is given
+ * whole lines, with `SFALLOC_CONF=cacheline:on`; `bench/run` runs them both
+ * ways.
+ *
+ * Built and run by `bench/run`; by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o cache-scratch-sf bench/cache-scratch.c \
+ *       bench/bench.c sf-alloc.c safeio.c allocconf.c -lpthread
+ *
+ * Output is one row of the suite's CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND MACRO CONSTANTS
+
+/** What each thread is given. */
+typedef struct worker {
+
+  pthread_t thread;
+
+  /** In scratch mode, the object to free before starting. */
+  char*     passed;
+
+} worker_s;
+
+#define DEFAULT_THREADS 4
+#define OBJECT_SIZE     8
+#define ITERATIONS      1000
+#define REPETITIONS     20000
+// ==============================================================================
+
+
+
+// ==============================================================================
+static void* work (void* arg) {
+
+  worker_s* worker = arg;
+  if (worker->passed != NULL) {
+    bench_serial_free(worker->passed);
+  }
+
+  for (size_t i = 0; i < ITERATIONS; i += 1) {
+    volatile char* object = bench_serial_malloc(OBJECT_SIZE);
+    for (size_t r = 0; r < REPETITIONS; r += 1) {
+      for (size_t b = 0; b < OBJECT_SIZE; b += 1) {
+	object[b] += 1;
+      }
+    }
+    bench_serial_free((void*)object);
+  }
+  return NULL;
+
+} // work ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  if (argc < 2 || argc > 3 || (strcmp(argv[1], "scratch") != 0 && strcmp(argv[1], "thrash") != 0)) {
+    fprintf(stderr, "USAGE: %s scratch|thrash [<threads>]\n", argv[0]);
+    return 1;
+  }
+  bool   scratch = strcmp(argv[1], "scratch") == 0;
+  size_t threads = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_THREADS;
+
+  worker_s* workers = bench_scratch(threads * sizeof(worker_s));
+  for (size_t t = 0; t < threads; t += 1) {
+    workers[t].passed = scratch ? malloc(OBJECT_SIZE) : NULL;
+  }
+
+  int counter = bench_counter_open();
+  bench_counter_start(counter);
+  double start = bench_now();
+
+  for (size_t t = 0; t < threads; t += 1) {
+    pthread_create(&workers[t].thread, NULL, work, &workers[t]);
+  }
+  for (size_t t = 0; t < threads; t += 1) {
+    pthread_join(workers[t].thread, NULL);
+  }
+
+  double   seconds = bench_now() - start;
+  uint64_t misses  = bench_counter_stop(counter);
+
+  char config[64];
+  snprintf(config, sizeof(config), "threads=%zu", threads);
+  bench_report(scratch ? "cache-scratch" : "cache-thrash", config,
+	       (uint64_t)threads * ITERATIONS * REPETITIONS, seconds, misses);
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,114 @@
+// ==============================================================================
+/**
+ * churn.c
+ *
+ * A benchmark of allocation from a churned, cache-cold heap.  A heap much
+ * larger than the last-level cache is filled with blocks of one size.  Each
+ * round then frees a random half of them, so that every run keeps some live
+ * blocks and its free list links the rest in no particular order, and
+ * allocates as many again, writing the first word of each block as a caller
+ * initializing it would.  Only the allocations are timed, so the benchmark
+ * measures how long popping the free lists stalls on cold links.
+ *
+ * `bench/run` runs it against sf-alloc both with and without its free-list
+ * prefetches (`-DNO_PREFETCH`); by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o churn-sf bench/churn.c bench/bench.c sf-alloc.c \
+ *       safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The bytes of blocks allocated at once, well beyond any last-level cache. */
+#define HEAP_BYTES (128 * 1024 * 1024)
+
+#define DEFAULT_SIZE 64
+#define ROUNDS       5
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Put the blocks in a random order (Fisher-Yates). */
+static void shuffle (void** blocks, size_t n, uint64_t* seed) {
+
+  for (size_t i = n - 1; i > 0; i -= 1) {
+    size_t j  = bench_random(seed) % (i + 1);
+    void*  t  = blocks[i];
+    blocks[i] = blocks[j];
+    blocks[j] = t;
+  }
+
+} // shuffle ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  if (argc > 2) {
+    fprintf(stderr, "USAGE: %s [<block size>]\n", argv[0]);
+    return 1;
+  }
+  size_t size = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_SIZE;
+  if (size < sizeof(size_t)) {
+    size = sizeof(size_t);
+  }
+
+  // Fill the heap.
+  size_t n      = HEAP_BYTES / size;
+  void** blocks = bench_scratch(n * sizeof(void*));
+  for (size_t i = 0; i < n; i += 1) {
+    blocks[i] = malloc(size);
+  }
+
+  int      counter = bench_counter_open();
+  uint64_t seed    = 0x2545f4914f6cdd1dull;
+  double   seconds = 0;
+  uint64_t misses  = 0;
+  for (size_t round = 0; round < ROUNDS; round += 1) {
+
+    // Churn it: free a random half.
+    shuffle(blocks, n, &seed);
+    for (size_t i = 0; i < n / 2; i += 1) {
+      free(blocks[i]);
+    }
+
+    bench_counter_start(counter);
+    double start = bench_now();
+    for (size_t i = 0; i < n / 2; i += 1) {
+      size_t* block = malloc(size);
+      block[0]      = i;
+      blocks[i]     = block;
+    }
+    seconds       += bench_now() - start;
+    uint64_t count = bench_counter_stop(counter);
+    misses         = (count == BENCH_NO_COUNT || misses == BENCH_NO_COUNT) ? BENCH_NO_COUNT : misses + count;
+
+  }
+
+  char config[64];
+  snprintf(config, sizeof(config), "size=%zu", size);
+  bench_report("churn", config, (uint64_t)ROUNDS * (n / 2), seconds, misses);
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,95 @@
+// ==============================================================================
+/**
+ * coloring.c
+ *
+ * A benchmark of cache conflicts among medium-sized objects.  An array holds
+ * pointers to many objects of 1 or 2 KB, and each pass over the array reads and
+ * writes only the first word of each object, as a lookup through an index of
+ * records would.  The words touched are few enough to fit in the L1 cache, but
+ * if every run places its blocks at the same offsets, they fall into only a
+ * handful of its sets and evict each other.  An allocator that colors its runs
+ * spreads them across the sets instead.
+ *
+ * `bench/run` runs it against sf-alloc both with coloring and without
+ * (`SFALLOC_CONF=color:off`); by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o coloring-sf bench/coloring.c bench/bench.c \
+ *       sf-alloc.c safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report for each object size and count.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The number of word accesses made for each configuration. */
+#define ACCESSES 100000000
+
+/** The object sizes and counts measured. */
+static const size_t sizes[]  = { 1024, 2048 };
+static const size_t counts[] = { 256, 512 };
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  (void)argv;
+  if (argc != 1) {
+    fprintf(stderr, "USAGE: %s\n", argv[0]);
+    return 1;
+  }
+
+  int counter = bench_counter_open();
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s += 1) {
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c += 1) {
+
+      size_t              count   = counts[c];
+      volatile uint64_t** objects = bench_scratch(count * sizeof(uint64_t*));
+      for (size_t i = 0; i < count; i += 1) {
+	objects[i]    = malloc(sizes[s]);
+	objects[i][0] = i;
+      }
+
+      size_t passes = ACCESSES / count;
+      bench_counter_start(counter);
+      double start = bench_now();
+
+      for (size_t pass = 0; pass < passes; pass += 1) {
+	for (size_t i = 0; i < count; i += 1) {
+	  objects[i][0] += 1;
+	}
+      }
+
+      double   seconds = bench_now() - start;
+      uint64_t misses  = bench_counter_stop(counter);
+
+      for (size_t i = 0; i < count; i += 1) {
+	free((void*)objects[i]);
+      }
+
+      char config[64];
+      snprintf(config, sizeof(config), "size=%zu,objects=%zu", sizes[s], count);
+      bench_report("coloring", config, (uint64_t)passes * count, seconds, misses);
+
+    }
+  }
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,111 @@
+// ==============================================================================
+/**
+ * larson.c
+ *
+ * The Larson server benchmark: each thread owns an array of blocks, and
+ * repeatedly replaces a random one with a block of a random size.  At the end
+ * of each epoch, every thread's array is handed on to the next thread, which
+ * then frees blocks that a different thread allocated.
+ *
+ * Neither allocator is thread-safe, so the threads here are logical ones,
+ * interleaved operation by operation on a single OS thread.  The pattern of
+ * allocations and frees matches that of the original.
+ *
+ * Built and run by `bench/run`; by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o larson-sf bench/larson.c bench/bench.c \
+ *       sf-alloc.c safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+#define DEFAULT_THREADS 4
+#define CHUNKS          1000
+#define MIN_SIZE        8
+#define MAX_SIZE        1000
+#define ROUNDS          10000
+#define EPOCHS          20
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  size_t threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_THREADS;
+  if (threads == 0) {
+    fprintf(stderr, "USAGE: %s [<threads>]\n", argv[0]);
+    return 1;
+  }
+
+  void***  arrays  = bench_scratch(threads * sizeof(void**));
+  uint64_t seed    = 1;
+  for (size_t t = 0; t < threads; t += 1) {
+    arrays[t] = bench_scratch(CHUNKS * sizeof(void*));
+    for (size_t i = 0; i < CHUNKS; i += 1) {
+      arrays[t][i] = malloc(MIN_SIZE + bench_random(&seed) % (MAX_SIZE - MIN_SIZE + 1));
+    }
+  }
+
+  int counter = bench_counter_open();
+  bench_counter_start(counter);
+  double start = bench_now();
+
+  uint64_t ops = 0;
+  for (size_t epoch = 0; epoch < EPOCHS; epoch += 1) {
+
+    for (size_t round = 0; round < ROUNDS; round += 1) {
+      for (size_t t = 0; t < threads; t += 1) {
+	uint64_t r     = bench_random(&seed);
+	size_t   victim = r % CHUNKS;
+	size_t   size   = MIN_SIZE + (r >> 32) % (MAX_SIZE - MIN_SIZE + 1);
+	free(arrays[t][victim]);
+	char* block = malloc(size);
+	block[0]    = (char)t;
+	arrays[t][victim] = block;
+	ops += 2;
+      }
+    }
+
+    // Hand each array on to the next thread.
+    void** first = arrays[0];
+    for (size_t t = 0; t + 1 < threads; t += 1) {
+      arrays[t] = arrays[t + 1];
+    }
+    arrays[threads - 1] = first;
+
+  }
+
+  double   seconds = bench_now() - start;
+  uint64_t misses  = bench_counter_stop(counter);
+
+  for (size_t t = 0; t < threads; t += 1) {
+    for (size_t i = 0; i < CHUNKS; i += 1) {
+      free(arrays[t][i]);
+    }
+  }
+
+  char config[64];
+  snprintf(config, sizeof(config), "threads=%zu", threads);
+  bench_report("larson", config, ops, seconds, misses);
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,83 @@
+// ==============================================================================
+/**
+ * malloc-simple.c
+ *
+ * The simplest allocator benchmark: for each of a range of sizes, allocate a
+ * large number of blocks of that size and then free them all, several times
+ * over.  It measures the fast paths and little else.
+ *
+ * Built and run by `bench/run`; by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o malloc-simple-sf bench/malloc-simple.c \
+ *       bench/bench.c sf-alloc.c safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report for each size.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+#define BLOCKS     10000
+#define ITERATIONS 20
+
+/** The sizes measured. */
+static const size_t sizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  (void)argv;
+  if (argc != 1) {
+    fprintf(stderr, "USAGE: %s\n", argv[0]);
+    return 1;
+  }
+
+  void** blocks  = bench_scratch(BLOCKS * sizeof(void*));
+  int    counter = bench_counter_open();
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s += 1) {
+
+    bench_counter_start(counter);
+    double start = bench_now();
+
+    for (size_t iteration = 0; iteration < ITERATIONS; iteration += 1) {
+      for (size_t i = 0; i < BLOCKS; i += 1) {
+	char* block = malloc(sizes[s]);
+	block[0]    = (char)i;
+	blocks[i]   = block;
+      }
+      for (size_t i = 0; i < BLOCKS; i += 1) {
+	free(blocks[i]);
+      }
+    }
+
+    double   seconds = bench_now() - start;
+    uint64_t misses  = bench_counter_stop(counter);
+
+    char config[64];
+    snprintf(config, sizeof(config), "size=%zu", sizes[s]);
+    bench_report("malloc-simple", config, 2 * (uint64_t)ITERATIONS * BLOCKS, seconds, misses);
+
+  }
+
+  return 0;
+
+} // main ()
+// ==============================================================================
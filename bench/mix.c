@@ -0,0 +1,114 @@
+// ==============================================================================
+/**
+ * mix.c
+ *
+ * A random mix of allocation sizes and lifetimes: a table of live blocks in
+ * which a random slot is replaced at each step.  Sizes are log-uniform between
+ * 8 bytes and 32 KB, so small blocks dominate by count and large ones by
+ * volume, and a block's lifetime is however long its slot goes unchosen.  One
+ * step in eight uses `realloc()` to resize the block in place of replacing it,
+ * and one in sixteen uses `calloc()`.
+ *
+ * Built and run by `bench/run`; by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o mix-bf bench/mix.c bench/bench.c bf-alloc.c \
+ *       safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+#define DEFAULT_SLOTS 10000
+#define STEPS         2000000
+#define MIN_LOG       3
+#define MAX_LOG       15
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Pick a log-uniform size between `1 << MIN_LOG` and `1 << MAX_LOG`. */
+static size_t random_size (uint64_t* seed) {
+
+  uint64_t r   = bench_random(seed);
+  unsigned log = MIN_LOG + r % (MAX_LOG - MIN_LOG);
+  size_t   low = (size_t)1 << log;
+  return low + (r >> 32) % low;
+
+} // random_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  size_t slots = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_SLOTS;
+  if (slots == 0) {
+    fprintf(stderr, "USAGE: %s [<live blocks>]\n", argv[0]);
+    return 1;
+  }
+
+  void**   blocks = bench_scratch(slots * sizeof(void*));
+  uint64_t seed   = 1;
+
+  int counter = bench_counter_open();
+  bench_counter_start(counter);
+  double start = bench_now();
+
+  uint64_t ops = 0;
+  for (size_t step = 0; step < STEPS; step += 1) {
+
+    uint64_t r     = bench_random(&seed);
+    size_t   slot  = r % slots;
+    size_t   size  = random_size(&seed);
+    unsigned which = (r >> 40) & 0xf;
+    char*    block;
+
+    if (which < 2 && blocks[slot] != NULL) {
+      block = realloc(blocks[slot], size);
+      ops  += 1;
+    } else {
+      if (blocks[slot] != NULL) {
+	free(blocks[slot]);
+	ops += 1;
+      }
+      block = (which == 2) ? calloc(1, size) : malloc(size);
+      ops  += 1;
+    }
+    block[0]        = (char)step;
+    block[size - 1] = (char)step;
+    blocks[slot]    = block;
+
+  }
+
+  double   seconds = bench_now() - start;
+  uint64_t misses  = bench_counter_stop(counter);
+
+  for (size_t i = 0; i < slots; i += 1) {
+    free(blocks[i]);
+  }
+
+  char config[64];
+  snprintf(config, sizeof(config), "slots=%zu", slots);
+  bench_report("mix", config, ops, seconds, misses);
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,120 @@
+// ==============================================================================
+/**
+ * numa-check.c
+ *
+ * Check where an allocator's memory actually lands on a NUMA machine.  Blocks
+ * of small, medium, and large sizes are allocated and written, and the kernel
+ * is then asked, through `move_pages()`, on which node each of their pages
+ * resides.  A count of pages per node is written to `stdout`.  If a node is
+ * named, any page found elsewhere is a failure, and the exit status is 1.
+ *
+ * Build it against an allocator compiled with `NUMA_AWARE`, and run it with
+ * the allocator's `numa` setting; for example:
+ *
+ *   gcc -O2 -fno-builtin -DNUMA_AWARE -o numa-check-sf bench/numa-check.c \
+ *       sf-alloc.c safeio.c allocconf.c numabind.c
+ *   SFALLOC_CONF=numa:1 ./numa-check-sf 1
+ *
+ * On a machine with a single node, memory is never bound, and every page is on
+ * node 0.  A machine with several nodes can be emulated with the kernel's
+ * `numa=fake=<n>` boot option.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The most nodes counted separately. */
+#define MAX_NODES 64
+
+/** The sizes of the blocks allocated, and how many of each. */
+static const size_t sizes[]  = { 64, 1024, 64 * 1024, 4 * 1024 * 1024 };
+static const size_t counts[] = { 4096, 1024, 64, 4 };
+
+/** The most pages checked. */
+#define MAX_PAGES 65536
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  if (argc > 2) {
+    fprintf(stderr, "USAGE: %s [<expected node>]\n", argv[0]);
+    return 1;
+  }
+  long expected  = argc > 1 ? strtol(argv[1], NULL, 0) : -1;
+  long page_size = sysconf(_SC_PAGESIZE);
+
+  // Allocate and write the blocks, noting each page that they touch.
+  static void* pages[MAX_PAGES];
+  static int   status[MAX_PAGES];
+  size_t       n = 0;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s += 1) {
+    for (size_t i = 0; i < counts[s]; i += 1) {
+      char* block = malloc(sizes[s]);
+      if (block == NULL) {
+	fprintf(stderr, "%s: malloc(%zu) failed\n", argv[0], sizes[s]);
+	return 1;
+      }
+      for (size_t offset = 0; offset < sizes[s]; offset += page_size) {
+	block[offset] = 1;
+	if (n < MAX_PAGES) {
+	  pages[n] = (void*)((uintptr_t)(block + offset) & ~(uintptr_t)(page_size - 1));
+	  n       += 1;
+	}
+      }
+    }
+  }
+
+  // With no target nodes, move_pages() only reports where each page is.
+  if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) == -1) {
+    perror("move_pages");
+    return 1;
+  }
+
+  size_t on_node[MAX_NODES] = { 0 };
+  size_t unknown            = 0;
+  size_t misplaced          = 0;
+  for (size_t i = 0; i < n; i += 1) {
+    if (status[i] >= 0 && status[i] < MAX_NODES) {
+      on_node[status[i]] += 1;
+    } else {
+      unknown += 1;
+    }
+    if (expected >= 0 && status[i] != expected) {
+      misplaced += 1;
+    }
+  }
+
+  for (int node = 0; node < MAX_NODES; node += 1) {
+    if (on_node[node] > 0) {
+      printf("node %d: %zu pages\n", node, on_node[node]);
+    }
+  }
+  if (unknown > 0) {
+    printf("unknown: %zu pages\n", unknown);
+  }
+  if (expected >= 0) {
+    printf("%zu of %zu pages not on node %ld\n", misplaced, n, expected);
+  }
+  return misplaced > 0 ? 1 : 0;
+
+} // main ()
+// ==============================================================================
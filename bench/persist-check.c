@@ -0,0 +1,201 @@
+// ==============================================================================
+/**
+ * persist-check.c
+ *
+ * Check that a heap kept in a file survives a restart.  The first run builds a
+ * list of numbered records in the heap, linked by offsets, frees every third
+ * one (so that the free list is not empty), and records the list's head as the
+ * root block.  Each later run finds the list through the root, checks every
+ * record, checks that the allocator's own counts agree with a walk of the
+ * heap and that no block has leaked, and then churns the list a little, so
+ * that the next run checks a heap reopened from a reused free list.  Every
+ * block the process allocates persists, so `stdout` is left unbuffered, lest
+ * its buffer leak into the heap on every run.  With `crash`, a run leaves by `_exit()`
+ * instead, skipping the allocator's close, so that the next run must rebuild
+ * the lists from the blocks.  The exit status is 1 on any mismatch.
+ *
+ * Build it against bf-alloc compiled with `PERSISTENT_HEAP`; for example:
+ *
+ *   gcc -O2 -fno-builtin -DPERSISTENT_HEAP -o persist-check bench/persist-check.c \
+ *       bf-alloc.c safeio.c allocconf.c heapfile.c
+ *   BFALLOC_CONF=persist:/tmp/heap,heap_size:64M ./persist-check
+ *   BFALLOC_CONF=persist:/tmp/heap,heap_size:64M ./persist-check crash
+ *   BFALLOC_CONF=persist:/tmp/heap,heap_size:64M ./persist-check
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../alloc.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND MACRO CONSTANTS
+
+/** A record, linked to the next by its offset in the heap. */
+typedef struct record {
+
+  size_t next;
+  size_t number;
+  size_t length;
+  char   payload[];
+
+} record_s;
+
+/** The root: the head of the list, and how many records it holds. */
+typedef struct root {
+
+  size_t head;
+  size_t count;
+  size_t next_number;
+
+} root_s;
+
+/** The number of records first built. */
+#define RECORDS 10000
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Allocate a record whose payload is derived from its number. */
+static record_s* new_record (size_t number) {
+
+  size_t    length = 8 + number % 200;
+  record_s* record = malloc(sizeof(record_s) + length);
+  if (record == NULL) {
+    fprintf(stderr, "persist-check: malloc() failed\n");
+    exit(1);
+  }
+  record->number = number;
+  record->length = length;
+  for (size_t i = 0; i < length; i += 1) {
+    record->payload[i] = (char)(number + i);
+  }
+  return record;
+
+} // new_record ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Does a record still hold what it was given? */
+static int record_ok (const record_s* record) {
+
+  if (record->length != 8 + record->number % 200) {
+    return 0;
+  }
+  for (size_t i = 0; i < record->length; i += 1) {
+    if (record->payload[i] != (char)(record->number + i)) {
+      return 0;
+    }
+  }
+  return 1;
+
+} // record_ok ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  int crash = (argc == 2 && strcmp(argv[1], "crash") == 0);
+  if (argc > 2 || (argc == 2 && !crash)) {
+    fprintf(stderr, "USAGE: %s [crash]\n", argv[0]);
+    return 1;
+  }
+  setvbuf(stdout, NULL, _IONBF, 0);
+
+  root_s* root = malloc_get_root();
+  if (root == NULL) {
+
+    // A new heap: build the list, dropping every third record.
+    root = malloc(sizeof(root_s));
+    memset(root, 0, sizeof(root_s));
+    size_t* link = &root->head;
+    for (size_t number = 0; number < RECORDS; number += 1) {
+      record_s* record = new_record(number);
+      if (number % 3 == 2) {
+	free(record);
+	continue;
+      }
+      *link        = malloc_offset(record);
+      link         = &record->next;
+      record->next = 0;
+      root->count += 1;
+    }
+    root->next_number = RECORDS;
+    malloc_set_root(root);
+    printf("created: %zu records\n", root->count);
+
+  } else {
+
+    // A reopened heap: check every record...
+    size_t count = 0;
+    for (record_s* record = malloc_at_offset(root->head); record != NULL; record = malloc_at_offset(record->next)) {
+      if (!record_ok(record)) {
+	printf("record %zu is corrupt\n", record->number);
+	return 1;
+      }
+      count += 1;
+    }
+    if (count != root->count) {
+      printf("found %zu records, expected %zu\n", count, root->count);
+      return 1;
+    }
+
+    // ...and the allocator's counts, which must find only the records and the
+    // root live.
+    alloc_stats_s stats;
+    alloc_frag_s  frag;
+    malloc_get_stats(&stats);
+    malloc_get_fragmentation(&frag);
+    if (stats.live_blocks != frag.live_blocks || stats.live_bytes != frag.live_bytes ||
+	stats.free_blocks != frag.free_blocks || stats.free_bytes != frag.free_bytes) {
+      printf("lists disagree with the heap: live %zu/%zu, free %zu/%zu\n",
+	     stats.live_blocks, frag.live_blocks, stats.free_blocks, frag.free_blocks);
+      return 1;
+    }
+    if (stats.live_blocks != count + 1) {
+      printf("%zu live blocks, expected %zu\n", stats.live_blocks, count + 1);
+      return 1;
+    }
+    printf("reopened: %zu records, %zu live blocks, %zu free blocks\n",
+	   count, stats.live_blocks, stats.free_blocks);
+
+    // Churn: replace the head's successor, so that the free list is reused.
+    record_s* head = malloc_at_offset(root->head);
+    record_s* old  = malloc_at_offset(head->next);
+    if (old != NULL) {
+      record_s* record = new_record(root->next_number);
+      root->next_number += 1;
+      record->next       = old->next;
+      head->next         = malloc_offset(record);
+      free(old);
+    }
+
+  }
+
+  if (crash) {
+    malloc_sync();
+    printf("crashing\n");
+    fflush(stdout);
+    _exit(0);
+  }
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,385 @@
+// ==============================================================================
+/**
+ * replay.c
+ *
+ * Replay a trace recorded by alloctrace against an allocator.  The trace is
+ * mapped, not read, and its events are replayed in timestamp order, so the
+ * interleaving of the recorded threads is preserved while the replay itself
+ * runs on one thread (neither allocator is thread-safe).  Each recorded block
+ * is mapped to the live block that stands in for it.
+ *
+ * Build against bf-alloc or sf-alloc, or without either to replay against the
+ * system allocator:
+ *
+ *   gcc -O2 -fno-builtin -o replay-bf bench/replay.c bench/bench.c \
+ *       bf-alloc.c safeio.c allocconf.c
+ *   gcc -O2 -fno-builtin -o replay-sf bench/replay.c bench/bench.c \
+ *       sf-alloc.c safeio.c allocconf.c
+ *   gcc -O2 -o replay-system bench/replay.c bench/bench.c
+ *
+ * Output is CSV: the label given, events replayed, seconds, millions of
+ * operations per second, latency percentiles and maximum in nanoseconds, peak
+ * RSS in kilobytes, peak live bytes requested, and the number of events that
+ * referred to blocks the trace never allocated (e.g., events that were dropped
+ * or that preceded the trace).
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../alloctrace.h"
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND MACRO CONSTANTS
+
+/** A recorded block and the live block standing in for it. */
+typedef struct binding {
+
+  /** The recorded address, or 0 if this slot of the table is empty. */
+  uint64_t recorded;
+
+  /** The live block. */
+  void*    live;
+
+  /** The number of bytes requested for it. */
+  size_t   size;
+
+} binding_s;
+
+/** Latencies are bucketed by their logs, each power of 2 split 8 ways. */
+#define LATENCY_SUB_BITS 3
+#define LATENCY_BUCKETS  512
+
+/** The percentiles reported, in thousandths. */
+static const unsigned percentiles[] = { 500, 900, 990, 999 };
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The table of bindings, which has `table_mask + 1` slots. */
+static binding_s* table      = NULL;
+static size_t     table_mask = 0;
+
+/** The number of operations that took each bucket's range of nanoseconds. */
+static uint64_t latencies[LATENCY_BUCKETS];
+// ==============================================================================
+
+
+
+// ==============================================================================
+static uint64_t now_ns () {
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+} // now_ns ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the latency bucket for a duration.  Below 8 ns, each nanosecond has its
+ * own bucket; above, each power of 2 is split into 8 equal buckets.
+ */
+static size_t latency_bucket (uint64_t ns) {
+
+  if (ns < (1 << LATENCY_SUB_BITS)) {
+    return ns;
+  }
+  unsigned log = 63 - __builtin_clzll(ns);
+  return ((log - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) +
+         ((ns >> (log - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+
+} // latency_bucket ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** The least duration that falls in a latency bucket. */
+static uint64_t bucket_floor (size_t bucket) {
+
+  if (bucket < (1 << LATENCY_SUB_BITS)) {
+    return bucket;
+  }
+  unsigned log = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+  uint64_t sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+  return ((1 << LATENCY_SUB_BITS) + sub) << (log - LATENCY_SUB_BITS);
+
+} // bucket_floor ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+static size_t slot_of (uint64_t recorded) {
+
+  return ((recorded >> 4) * 0x9e3779b97f4a7c15ull >> 20) & table_mask;
+
+} // slot_of ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Bind a recorded block to a live one. */
+static void bind (uint64_t recorded, void* live, size_t size) {
+
+  size_t slot = slot_of(recorded);
+  while (table[slot].recorded != 0 && table[slot].recorded != recorded) {
+    slot = (slot + 1) & table_mask;
+  }
+  table[slot].recorded = recorded;
+  table[slot].live     = live;
+  table[slot].size     = size;
+
+} // bind ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find and remove the binding of a recorded block, shifting later entries back
+ * to keep every search unbroken.
+ *
+ * \return The binding's slot contents, or a binding with `recorded` 0 if none.
+ */
+static binding_s unbind (uint64_t recorded) {
+
+  binding_s found = { 0, NULL, 0 };
+  size_t    slot  = slot_of(recorded);
+  while (table[slot].recorded != recorded) {
+    if (table[slot].recorded == 0) {
+      return found;
+    }
+    slot = (slot + 1) & table_mask;
+  }
+  found = table[slot];
+
+  size_t hole = slot;
+  for (size_t next = (hole + 1) & table_mask; table[next].recorded != 0; next = (next + 1) & table_mask) {
+    size_t home = slot_of(table[next].recorded);
+    if (((next - home) & table_mask) >= ((next - hole) & table_mask)) {
+      table[hole] = table[next];
+      hole        = next;
+    }
+  }
+  table[hole].recorded = 0;
+  return found;
+
+} // unbind ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Sort the events' indices by timestamp with a stable, bottom-up merge sort, in
+ * scratch space rather than the heap under test.
+ */
+static uint32_t* sort_events (const alloctrace_event_s* events, size_t count) {
+
+  uint32_t* order   = bench_scratch(count * sizeof(uint32_t));
+  uint32_t* spare   = bench_scratch(count * sizeof(uint32_t));
+  for (size_t i = 0; i < count; i += 1) {
+    order[i] = i;
+  }
+
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t low = 0; low < count; low += 2 * width) {
+      size_t middle = low + width < count ? low + width : count;
+      size_t high   = low + 2 * width < count ? low + 2 * width : count;
+      size_t left   = low;
+      size_t right  = middle;
+      for (size_t out = low; out < high; out += 1) {
+	if (left < middle &&
+	    (right >= high || events[order[left]].timestamp <= events[order[right]].timestamp)) {
+	  spare[out] = order[left++];
+	} else {
+	  spare[out] = order[right++];
+	}
+      }
+    }
+    uint32_t* swap = order;
+    order          = spare;
+    spare          = swap;
+  }
+
+  return order;
+
+} // sort_events ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Touch each page of a new block, as the program that made it would have. */
+static void touch (void* block, size_t size) {
+
+  for (size_t offset = 0; offset < size; offset += 4096) {
+    ((volatile char*)block)[offset] = 1;
+  }
+
+} // touch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "USAGE: %s <trace> [<label>]\n", argv[0]);
+    return 1;
+  }
+  const char* label = argc > 2 ? argv[2] : "replay";
+
+  // Map the trace and check its header.
+  int         fd = open(argv[1], O_RDONLY);
+  struct stat info;
+  if (fd == -1 || fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(alloctrace_header_s)) {
+    fprintf(stderr, "%s: cannot read trace %s\n", argv[0], argv[1]);
+    return 1;
+  }
+  const char* trace = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (trace == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  const alloctrace_header_s* header = (const alloctrace_header_s*)trace;
+  if (memcmp(header->magic, ALLOCTRACE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != ALLOCTRACE_VERSION ||
+      header->event_size != sizeof(alloctrace_event_s)) {
+    fprintf(stderr, "%s: %s is not a version %d trace\n", argv[0], argv[1], ALLOCTRACE_VERSION);
+    return 1;
+  }
+  const alloctrace_event_s* events = (const alloctrace_event_s*)(trace + sizeof(alloctrace_header_s));
+  size_t                    count  = (info.st_size - sizeof(alloctrace_header_s)) / sizeof(alloctrace_event_s);
+  uint32_t*                 order  = sort_events(events, count);
+
+  // Size the bindings table so that it is never more than half full.
+  size_t slots = 1024;
+  while (slots < 2 * count) {
+    slots *= 2;
+  }
+  table      = bench_scratch(slots * sizeof(binding_s));
+  table_mask = slots - 1;
+
+  size_t   live_bytes = 0;
+  size_t   peak_live  = 0;
+  size_t   unmatched  = 0;
+  uint64_t max_ns     = 0;
+  uint64_t total_ns   = 0;
+  for (size_t i = 0; i < count; i += 1) {
+
+    const alloctrace_event_s* event = &events[order[i]];
+    void*                     block = NULL;
+    binding_s                 old   = { 0, NULL, 0 };
+    uint64_t                  start = 0;
+    uint64_t                  end   = 0;
+    switch (event->op) {
+
+    case ALLOCTRACE_MALLOC:
+    case ALLOCTRACE_CALLOC:
+      start = now_ns();
+      block = (event->op == ALLOCTRACE_MALLOC) ? malloc(event->size) : calloc(1, event->size);
+      end   = now_ns();
+      break;
+
+    case ALLOCTRACE_REALLOC:
+      old = unbind(event->old_ptr);
+      if (old.recorded == 0) {
+	unmatched += 1;
+	continue;
+      }
+      live_bytes -= old.size;
+      start = now_ns();
+      block = realloc(old.live, event->size);
+      end   = now_ns();
+      break;
+
+    case ALLOCTRACE_FREE:
+      old = unbind(event->ptr);
+      if (old.recorded == 0) {
+	unmatched += 1;
+	continue;
+      }
+      live_bytes -= old.size;
+      start = now_ns();
+      free(old.live);
+      end   = now_ns();
+      break;
+
+    default:
+      fprintf(stderr, "%s: unknown event %u\n", argv[0], event->op);
+      return 1;
+
+    }
+
+    uint64_t ns = end - start;
+    latencies[latency_bucket(ns)] += 1;
+    total_ns                      += ns;
+    if (ns > max_ns) {
+      max_ns = ns;
+    }
+
+    if (event->op != ALLOCTRACE_FREE && block != NULL) {
+      touch(block, event->size);
+      bind(event->ptr, block, event->size);
+      live_bytes += event->size;
+      if (live_bytes > peak_live) {
+	peak_live = live_bytes;
+      }
+    }
+
+  }
+
+  // Find the percentiles in the histogram.
+  size_t   replayed = count - unmatched;
+  uint64_t points[sizeof(percentiles) / sizeof(percentiles[0])];
+  size_t   seen     = 0;
+  size_t   next     = 0;
+  for (size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket += 1) {
+    seen += latencies[bucket];
+    while (next < sizeof(percentiles) / sizeof(percentiles[0]) &&
+	   seen * 1000 >= replayed * percentiles[next] && seen > 0) {
+      points[next++] = bucket_floor(bucket);
+    }
+  }
+  while (next < sizeof(percentiles) / sizeof(percentiles[0])) {
+    points[next++] = max_ns;
+  }
+
+  double seconds = total_ns / 1e9;
+  printf("label,events,seconds,mops,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,peak_rss_kb,peak_live_bytes,unmatched\n");
+  printf("%s,%zu,%.6f,%.3f,%lu,%lu,%lu,%lu,%lu,%ld,%zu,%zu\n",
+	 label, replayed, seconds, seconds > 0 ? replayed / seconds / 1e6 : 0.0,
+	 points[0], points[1], points[2], points[3], max_ns,
+	 bench_peak_rss_kb(), peak_live, unmatched);
+  return 0;
+
+} // main ()
+// ==============================================================================
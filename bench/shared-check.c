@@ -0,0 +1,221 @@
+// ==============================================================================
+/**
+ * shared-check.c
+ *
+ * Check a heap shared by several processes.  Worker processes, forked after
+ * the heap is created, allocate records in it and hand them to the parent as
+ * offsets through a pipe, eight bytes apiece, churning blocks of their own in
+ * between.  The parent checks and frees every record it is handed, so that
+ * blocks are allocated in one process and freed in another.  With `kill`, one
+ * more worker does nothing but churn and is killed partway, likely while it
+ * holds the heap's lock, so that the next process to take the lock must
+ * rebuild the lists.  At the end, the allocator's counts must agree with a
+ * walk of the heap.  The exit status is 1 on any mismatch.
+ *
+ * Build it against bf-alloc compiled with `PERSISTENT_HEAP`; for example:
+ *
+ *   gcc -O2 -fno-builtin -DPERSISTENT_HEAP -o shared-check bench/shared-check.c \
+ *       bench/bench.c bf-alloc.c safeio.c allocconf.c heapfile.c
+ *   BFALLOC_CONF=shared:memfd,heap_size:256M ./shared-check 4
+ *   BFALLOC_CONF=shared:/shared-check,heap_size:256M ./shared-check 4 kill
+ *
+ * A named heap outlives the processes; remove it from `/dev/shm` afterwards.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../alloc.h"
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND MACRO CONSTANTS
+
+/** A record handed from a worker to the parent. */
+typedef struct record {
+
+  uint64_t worker;
+  uint64_t number;
+  uint64_t length;
+  uint8_t  payload[];
+
+} record_s;
+
+/** The records that each worker hands over. */
+#define RECORDS 10000
+
+/** The blocks that each worker keeps of its own, churning them. */
+#define OWN_BLOCKS 64
+
+/** How long the killed worker churns, in microseconds, before it is killed. */
+#define KILL_AFTER 200000
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** The byte at a given place in a record's payload. */
+static uint8_t pattern (const record_s* record, size_t i) {
+
+  return (uint8_t)(record->worker * 31 + record->number * 7 + i);
+
+} // pattern ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Replace one of a worker's own blocks with a new one of random size. */
+static void churn (void** own, uint64_t* seed) {
+
+  size_t slot = bench_random(seed) % OWN_BLOCKS;
+  free(own[slot]);
+  own[slot] = malloc(1 + bench_random(seed) % 4096);
+
+} // churn ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Hand over records, churning between them; or, with no pipe, churn until killed. */
+static void work (uint64_t worker, int pipe_fd) {
+
+  uint64_t seed = 0x9e3779b97f4a7c15ull * (worker + 1);
+  void*    own[OWN_BLOCKS];
+  memset(own, 0, sizeof(own));
+
+  if (pipe_fd == -1) {
+    for (;;) {
+      churn(own, &seed);
+    }
+  }
+
+  for (uint64_t number = 0; number < RECORDS; number += 1) {
+    size_t    length = 1 + bench_random(&seed) % 2000;
+    record_s* record = malloc(sizeof(record_s) + length);
+    if (record == NULL) {
+      fprintf(stderr, "shared-check: worker %lu: malloc() failed\n", (unsigned long)worker);
+      _exit(1);
+    }
+    record->worker = worker;
+    record->number = number;
+    record->length = length;
+    for (size_t i = 0; i < length; i += 1) {
+      record->payload[i] = pattern(record, i);
+    }
+    size_t offset = malloc_offset(record);
+    if (write(pipe_fd, &offset, sizeof(offset)) != sizeof(offset)) {
+      _exit(1);
+    }
+    churn(own, &seed);
+  }
+  _exit(0);
+
+} // work ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  int kill_one = (argc == 3 && strcmp(argv[2], "kill") == 0);
+  if (argc < 2 || argc > 3 || (argc == 3 && !kill_one)) {
+    fprintf(stderr, "USAGE: %s <workers> [kill]\n", argv[0]);
+    return 1;
+  }
+  int workers = atoi(argv[1]);
+
+  // Create the heap before forking, so that every worker shares it.
+  free(malloc(1));
+  int pipe_fds[2];
+  if (pipe(pipe_fds) == -1) {
+    perror("pipe");
+    return 1;
+  }
+
+  pid_t victim = -1;
+  if (kill_one) {
+    victim = fork();
+    if (victim == 0) {
+      work(workers, -1);
+    }
+  }
+  for (int worker = 0; worker < workers; worker += 1) {
+    if (fork() == 0) {
+      close(pipe_fds[0]);
+      work(worker, pipe_fds[1]);
+    }
+  }
+  close(pipe_fds[1]);
+  if (kill_one) {
+    usleep(KILL_AFTER);
+    kill(victim, SIGKILL);
+    waitpid(victim, NULL, 0);
+  }
+
+  // Check and free every record handed over.
+  size_t   received = 0;
+  uint64_t next[workers];
+  memset(next, 0, sizeof(next));
+  size_t offset;
+  while (read(pipe_fds[0], &offset, sizeof(offset)) == sizeof(offset)) {
+    record_s* record = malloc_at_offset(offset);
+    if (record->worker >= (uint64_t)workers || record->number != next[record->worker]) {
+      printf("record at offset %zu is out of order\n", offset);
+      return 1;
+    }
+    for (size_t i = 0; i < record->length; i += 1) {
+      if (record->payload[i] != pattern(record, i)) {
+	printf("record %lu of worker %lu is corrupt\n",
+	       (unsigned long)record->number, (unsigned long)record->worker);
+	return 1;
+      }
+    }
+    next[record->worker] += 1;
+    received             += 1;
+    free(record);
+  }
+
+  int failed = 0;
+  for (int worker = 0; worker < workers; worker += 1) {
+    int status;
+    wait(&status);
+    failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+  }
+
+  alloc_stats_s stats;
+  alloc_frag_s  frag;
+  malloc_get_stats(&stats);
+  malloc_get_fragmentation(&frag);
+  printf("received %zu of %d records; %zu live blocks, %zu free blocks\n",
+	 received, workers * RECORDS, stats.live_blocks, stats.free_blocks);
+  if (failed || received != (size_t)workers * RECORDS) {
+    printf("a worker failed\n");
+    return 1;
+  }
+  if (stats.live_blocks != frag.live_blocks || stats.live_bytes != frag.live_bytes ||
+      stats.free_blocks != frag.free_blocks || stats.free_bytes != frag.free_bytes) {
+    printf("lists disagree with the heap: live %zu/%zu, free %zu/%zu\n",
+	   stats.live_blocks, frag.live_blocks, stats.free_blocks, frag.free_blocks);
+    return 1;
+  }
+  return 0;
+
+} // main ()
+// ==============================================================================
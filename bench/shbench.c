@@ -0,0 +1,87 @@
+// ==============================================================================
+/**
+ * shbench.c
+ *
+ * The MicroQuill SmartHeap benchmark: repeated passes, each of which allocates
+ * a batch of blocks of random sizes, frees every other one, refills the holes
+ * with blocks of new sizes, and then frees the whole batch.  The holes left
+ * half-way through a pass test how well the allocator reuses fragments.
+ *
+ * Built and run by `bench/run`; by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o shbench-bf bench/shbench.c bench/bench.c \
+ *       bf-alloc.c safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+#define BATCH    1000
+#define MIN_SIZE 1
+#define MAX_SIZE 1000
+#define PASSES   500
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  size_t passes = argc > 1 ? strtoul(argv[1], NULL, 0) : PASSES;
+
+  void**   blocks = bench_scratch(BATCH * sizeof(void*));
+  uint64_t seed   = 1;
+
+  int counter = bench_counter_open();
+  bench_counter_start(counter);
+  double start = bench_now();
+
+  uint64_t ops = 0;
+  for (size_t pass = 0; pass < passes; pass += 1) {
+
+    for (size_t i = 0; i < BATCH; i += 1) {
+      char* block = malloc(MIN_SIZE + bench_random(&seed) % (MAX_SIZE - MIN_SIZE + 1));
+      block[0]    = (char)i;
+      blocks[i]   = block;
+    }
+    for (size_t i = 0; i < BATCH; i += 2) {
+      free(blocks[i]);
+    }
+    for (size_t i = 0; i < BATCH; i += 2) {
+      char* block = malloc(MIN_SIZE + bench_random(&seed) % (MAX_SIZE - MIN_SIZE + 1));
+      block[0]    = (char)i;
+      blocks[i]   = block;
+    }
+    for (size_t i = 0; i < BATCH; i += 1) {
+      free(blocks[i]);
+    }
+    ops += 3 * BATCH;
+
+  }
+
+  double   seconds = bench_now() - start;
+  uint64_t misses  = bench_counter_stop(counter);
+
+  char config[64];
+  snprintf(config, sizeof(config), "passes=%zu", passes);
+  bench_report("shbench", config, ops, seconds, misses);
+  return 0;
+
+} // main ()
+// ==============================================================================
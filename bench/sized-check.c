@@ -0,0 +1,100 @@
+// ==============================================================================
+/**
+ * sized-check.c
+ *
+ * Check that a block resized by `realloc()` can be freed by `free_sized()`
+ * with its new size.  For every pair of sizes drawn from the small, medium,
+ * and large ranges, a block is allocated with the first, filled, resized to
+ * the second, checked, and freed with the second.  A block left in a size
+ * class other than the one its new size names would be freed into the wrong
+ * class; sf-alloc's `free_sized()` dies on that.  At the end, the allocator's
+ * counts must show every block freed.  The exit status is 1 on any mismatch.
+ *
+ * Build it against either allocator; for example:
+ *
+ *   gcc -O2 -fno-builtin -o sized-check bench/sized-check.c \
+ *       sf-alloc.c safeio.c allocconf.c
+ *   ./sized-check
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../alloc.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The number of sizes tried. */
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** Sizes on either side of the class boundaries, and well into each range. */
+static const size_t sizes[] = { 1, 8, 16, 20, 24, 100, 128, 129, 1000, 1024, 2000,
+				4096, 8192, 65536, 100000, 1 << 20, (1 << 20) + 1,
+				4 << 20, 16 << 20 };
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main () {
+
+  alloc_stats_s before;
+  malloc_get_stats(&before);
+
+  for (size_t i = 0; i < SIZES; i += 1) {
+    for (size_t j = 0; j < SIZES; j += 1) {
+      size_t   from  = sizes[i];
+      size_t   to    = sizes[j];
+      size_t   kept  = from < to ? from : to;
+      uint8_t* block = malloc(from);
+      if (block == NULL) {
+	fprintf(stderr, "sized-check: malloc() failed\n");
+	return 1;
+      }
+      for (size_t k = 0; k < from; k += 1) {
+	block[k] = (uint8_t)(k * 7 + from);
+      }
+      uint8_t* resized = realloc(block, to);
+      if (resized == NULL) {
+	fprintf(stderr, "sized-check: realloc() failed\n");
+	return 1;
+      }
+      for (size_t k = 0; k < kept; k += 1) {
+	if (resized[k] != (uint8_t)(k * 7 + from)) {
+	  printf("realloc() from %zu to %zu lost byte %zu\n", from, to, k);
+	  return 1;
+	}
+      }
+      free_sized(resized, to);
+    }
+  }
+
+  alloc_stats_s after;
+  malloc_get_stats(&after);
+  printf("%zu resizes; live blocks %zu before, %zu after\n",
+	 SIZES * SIZES, before.live_blocks, after.live_blocks);
+  if (after.live_blocks != before.live_blocks) {
+    printf("blocks were lost\n");
+    return 1;
+  }
+  return 0;
+
+} // main ()
+// ==============================================================================
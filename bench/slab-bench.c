@@ -0,0 +1,111 @@
+// ==============================================================================
+/**
+ * slab-bench.c
+ *
+ * Compare sf-alloc's slab modes: intrusive free lists (the default) and free
+ * slot bitmaps (`SLAB_BITMAP`).  For each of several block sizes, a working set
+ * of blocks is churned by freeing a random block and allocating a replacement.
+ * The blocks are never touched by the benchmark itself, so any cache misses
+ * are the allocator's own.
+ *
+ * Build once per mode, and run both with the same arguments:
+ *
+ *   gcc -O2 -fno-builtin -o slab-list bench/slab-bench.c bench/bench.c \
+ *       sf-alloc.c safeio.c allocconf.c
+ *   gcc -O2 -fno-builtin -mavx2 -DSLAB_BITMAP -o slab-bitmap \
+ *       bench/slab-bench.c bench/bench.c sf-alloc.c safeio.c allocconf.c
+ *
+ * Output is CSV: mode, block size, operations, seconds, millions of
+ * operations per second, and cache misses per operation.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+#if defined (SLAB_BITMAP)
+#define MODE "bitmap"
+#else
+#define MODE "list"
+#endif
+
+/** The default number of live blocks in the working set. */
+#define DEFAULT_WORKING_SET (1 << 18)
+
+/** The default number of free/malloc pairs per block size. */
+#define DEFAULT_OPS (1 << 24)
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  if (argc > 3) {
+    fprintf(stderr, "USAGE: %s [<working set> [<ops>]]\n", argv[0]);
+    return 1;
+  }
+  size_t working_set = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_WORKING_SET;
+  size_t ops         = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_OPS;
+
+  static const size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+  void**   blocks  = bench_scratch(working_set * sizeof(void*));
+  int      counter = bench_counter_open();
+  uint64_t seed    = 1;
+
+  printf("mode,size,ops,seconds,mops,misses_per_op\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s += 1) {
+
+    // Fill the working set, then scramble it so that later frees are spread
+    // across all of its pages.
+    for (size_t i = 0; i < working_set; i += 1) {
+      blocks[i] = malloc(sizes[s]);
+    }
+    for (size_t i = 0; i < working_set; i += 1) {
+      size_t j = bench_random(&seed) % working_set;
+      free(blocks[j]);
+      blocks[j] = malloc(sizes[s]);
+    }
+
+    // Churn.
+    bench_counter_start(counter);
+    double start = bench_now();
+    for (size_t op = 0; op < ops; op += 1) {
+      size_t i = bench_random(&seed) % working_set;
+      free(blocks[i]);
+      blocks[i] = malloc(sizes[s]);
+    }
+    double   seconds = bench_now() - start;
+    uint64_t misses  = bench_counter_stop(counter);
+
+    if (misses == BENCH_NO_COUNT) {
+      printf("%s,%zu,%zu,%.3f,%.2f,n/a\n", MODE, sizes[s], ops, seconds,
+	     ops / seconds / 1e6);
+    } else {
+      printf("%s,%zu,%zu,%.3f,%.2f,%.3f\n", MODE, sizes[s], ops, seconds,
+	     ops / seconds / 1e6, (double)misses / ops);
+    }
+
+    for (size_t i = 0; i < working_set; i += 1) {
+      free(blocks[i]);
+    }
+
+  }
+
+  return 0;
+
+} // main ()
+// ==============================================================================
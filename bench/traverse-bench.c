@@ -0,0 +1,144 @@
+// ==============================================================================
+/**
+ * traverse-bench.c
+ *
+ * Measure the locality of consecutively allocated objects.  The heap is first
+ * churned so that free blocks are scattered across many pages.  Then a linked
+ * list is built from consecutive allocations and traversed repeatedly.  The
+ * report gives the traversal time per node and how often consecutive nodes lie
+ * on different pages, which does not depend on hardware counters.
+ *
+ * Build against sf-alloc, or without it to measure the system allocator:
+ *
+ *   gcc -O2 -fno-builtin -o traverse-sf bench/traverse-bench.c bench/bench.c \
+ *       sf-alloc.c safeio.c allocconf.c
+ *   gcc -O2 -o traverse-system bench/traverse-bench.c bench/bench.c
+ *
+ * Output is CSV: node size, nodes, nanoseconds per node visited, page switches
+ * per node, and cache misses per node visited.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND MACRO CONSTANTS
+
+/** A list node, padded out to the size being measured. */
+typedef struct node {
+
+  struct node* next;
+  uint64_t     value;
+
+} node_s;
+
+/** The number of blocks used to churn the heap before each list is built. */
+#define CHURN_BLOCKS (1 << 19)
+
+/** The default number of nodes in each list. */
+#define DEFAULT_NODES (1 << 16)
+
+/** The default number of traversals of each list. */
+#define DEFAULT_PASSES 200
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  if (argc > 3) {
+    fprintf(stderr, "USAGE: %s [<nodes> [<passes>]]\n", argv[0]);
+    return 1;
+  }
+  size_t nodes  = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_NODES;
+  size_t passes = argc > 2 ? strtoul(argv[2], NULL, 0) : DEFAULT_PASSES;
+
+  static const size_t sizes[] = { 16, 32, 64, 128, 256 };
+  void**   churn     = bench_scratch(CHURN_BLOCKS * sizeof(void*));
+  int      counter   = bench_counter_open();
+  intptr_t page_mask = ~(intptr_t)(sysconf(_SC_PAGESIZE) - 1);
+  uint64_t seed      = 1;
+
+  printf("size,nodes,ns_per_node,page_switches_per_node,misses_per_node\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s += 1) {
+
+    // Fill the heap with blocks of this size, then free a random half of them,
+    // leaving holes on every page.
+    for (size_t i = 0; i < CHURN_BLOCKS; i += 1) {
+      churn[i] = malloc(sizes[s]);
+    }
+    for (size_t i = 0; i < CHURN_BLOCKS; i += 1) {
+      size_t j = bench_random(&seed) % CHURN_BLOCKS;
+      free(churn[j]);
+      churn[j] = NULL;
+    }
+
+    // Build the list from consecutive allocations, in allocation order.
+    node_s*  head          = NULL;
+    node_s** tail          = &head;
+    size_t   page_switches = 0;
+    for (size_t i = 0; i < nodes; i += 1) {
+      node_s* node = malloc(sizes[s]);
+      node->next   = NULL;
+      node->value  = i;
+      if (i > 0 && (((intptr_t)node ^ (intptr_t)tail) & page_mask) != 0) {
+	page_switches += 1;
+      }
+      *tail = node;
+      tail  = &node->next;
+    }
+
+    // Traverse it.
+    uint64_t sum = 0;
+    bench_counter_start(counter);
+    double start = bench_now();
+    for (size_t pass = 0; pass < passes; pass += 1) {
+      for (node_s* node = head; node != NULL; node = node->next) {
+	sum += node->value;
+      }
+    }
+    double   seconds = bench_now() - start;
+    uint64_t misses  = bench_counter_stop(counter);
+    size_t   visits  = nodes * passes;
+
+    printf("%zu,%zu,%.2f,%.3f,", sizes[s], nodes, seconds * 1e9 / visits,
+	   (double)page_switches / nodes);
+    if (misses == BENCH_NO_COUNT) {
+      printf("n/a\n");
+    } else {
+      printf("%.3f\n", (double)misses / visits);
+    }
+    if (sum == 0) {
+      printf("# unexpected checksum\n");
+    }
+
+    // Tear everything down before the next size.
+    while (head != NULL) {
+      node_s* next = head->next;
+      free(head);
+      head = next;
+    }
+    for (size_t i = 0; i < CHURN_BLOCKS; i += 1) {
+      free(churn[i]);
+    }
+
+  }
+
+  return 0;
+
+} // main ()
+// ==============================================================================
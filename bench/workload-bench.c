@@ -0,0 +1,85 @@
+// ==============================================================================
+/**
+ * workload-bench.c
+ *
+ * Run a synthetic workload, described phase by phase on the command line (see
+ * `workload_parse_phase()` in workload.h), for example:
+ *
+ *   workload-bench-sf "steps=500000,alloc=100,live=500000,size=lognormal:5:1" \
+ *                     "steps=2000000,size=uniform:16:4096,life=exp:10000" \
+ *                     "steps=500000,alloc=0"
+ *
+ * Without arguments, it runs the old sf-alloc test harness's workload: fill
+ * the heap with blocks of up to 2 KB, free them in random order, and then do it
+ * again.
+ *
+ * Build against either allocator:
+ *
+ *   gcc -O2 -fno-builtin -o workload-bench-bf bench/workload-bench.c \
+ *       bench/workload.c bench/bench.c bf-alloc.c safeio.c allocconf.c -lm
+ *   gcc -O2 -fno-builtin -o workload-bench-sf bench/workload-bench.c \
+ *       bench/workload.c bench/bench.c sf-alloc.c safeio.c allocconf.c -lm
+ *
+ * Output is one row of the suite's CSV report per phase.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "workload.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The phases run when none are given. */
+static const char* default_phases[] = {
+  "steps=250000,alloc=100,live=250000,size=uniform:16:2048",
+  "steps=250000,alloc=0",
+  "steps=250000,alloc=100,live=250000,size=uniform:16:2048",
+  "steps=250000,alloc=0"
+};
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  const char** specs = (const char**)&argv[1];
+  size_t       count = argc - 1;
+  if (count == 0) {
+    specs = default_phases;
+    count = sizeof(default_phases) / sizeof(default_phases[0]);
+  }
+
+  workload_phase_s*  phases  = bench_scratch(count * sizeof(workload_phase_s));
+  workload_result_s* results = bench_scratch(count * sizeof(workload_result_s));
+  for (size_t p = 0; p < count; p += 1) {
+    if (!workload_parse_phase(specs[p], &phases[p])) {
+      fprintf(stderr, "USAGE: %s [<phase> ...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  workload_run(phases, count, 1, results);
+
+  for (size_t p = 0; p < count; p += 1) {
+    char config[64];
+    snprintf(config, sizeof(config), "phase=%zu peak_live_kb=%zu", p, results[p].peak_live_bytes / 1024);
+    bench_report("workload", config, results[p].mallocs + results[p].frees,
+		 results[p].seconds, results[p].misses);
+  }
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -0,0 +1,486 @@
+// ==============================================================================
+/**
+ * workload.c
+ *
+ * A synthetic workload generator.  Live blocks are kept in an array so that a
+ * block chosen at random can be freed by moving the last one into its place,
+ * and blocks with set lifetimes are also kept on a timing wheel, a ring of
+ * lists indexed by the step at which they die, so that each step finds its
+ * dying blocks without searching.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "workload.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND MACRO CONSTANTS
+
+/** A live block. */
+typedef struct record {
+
+  void*    block;
+  size_t   size;
+
+  /** The record's position in the array of live records. */
+  uint32_t position;
+
+  /** The wheel bucket the record is on, or `NONE`, and its neighbors there. */
+  uint32_t bucket;
+  uint32_t next;
+  uint32_t prev;
+
+} record_s;
+
+/** The null record index. */
+#define NONE UINT32_MAX
+
+/** The number of wheel buckets, which must exceed the longest lifetime. */
+#define WHEEL_BUCKETS (WORKLOAD_MAX_LIFETIME * 2)
+
+/** The phase settings used when a description omits them. */
+#define DEFAULT_STEPS         1000000
+#define DEFAULT_ALLOC_PERCENT 50
+#define DEFAULT_MIN_SIZE      16
+#define DEFAULT_MAX_SIZE      2048
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The records, and a stack of those not in use. */
+static record_s* records      = NULL;
+static uint32_t* unused       = NULL;
+static size_t    unused_count = 0;
+
+/** The indices of the live records. */
+static uint32_t* live       = NULL;
+static size_t    live_count = 0;
+static size_t    live_bytes = 0;
+
+/** The first record of each wheel bucket. */
+static uint32_t* wheel = NULL;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Draw a uniform random number in [0, 1). */
+static double random_unit (uint64_t* seed) {
+
+  return (bench_random(seed) >> 11) * (1.0 / (UINT64_C(1) << 53));
+
+} // random_unit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+size_t workload_size (const workload_sizes_s* sizes, uint64_t* seed) {
+
+  switch (sizes->dist) {
+
+  case WORKLOAD_SIZE_LOGNORMAL: {
+    // Box-Muller, taking one of the pair of normal deviates it yields.
+    double u    = 1.0 - random_unit(seed);
+    double v    = random_unit(seed);
+    double z    = sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+    double size = exp(sizes->mu + sizes->sigma * z);
+    if (size < (double)sizes->min) {
+      return sizes->min;
+    }
+    if (size > (double)sizes->max) {
+      return sizes->max;
+    }
+    return (size_t)size;
+  }
+
+  case WORKLOAD_SIZE_EMPIRICAL: {
+    uint64_t pick = bench_random(seed) % sizes->cumulative[sizes->buckets - 1];
+    size_t   low  = 0;
+    size_t   high = sizes->buckets - 1;
+    while (low < high) {
+      size_t middle = (low + high) / 2;
+      if (sizes->cumulative[middle] > pick) {
+	high = middle;
+      } else {
+	low = middle + 1;
+      }
+    }
+    return sizes->bucket_size[low];
+  }
+
+  default:
+    return sizes->min + bench_random(seed) % (sizes->max - sizes->min + 1);
+
+  }
+
+} // workload_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Draw a lifetime from a distribution.
+ *
+ * \return The lifetime, in steps, between 1 and `WORKLOAD_MAX_LIFETIME`; or 0
+ *         if blocks have no set lifetime.
+ */
+static size_t lifetime (const workload_lifetimes_s* lifetimes, uint64_t* seed) {
+
+  size_t steps;
+  switch (lifetimes->dist) {
+
+  case WORKLOAD_LIFE_EXPONENTIAL:
+    steps = (size_t)(-lifetimes->mean * log(1.0 - random_unit(seed)));
+    break;
+
+  case WORKLOAD_LIFE_UNIFORM:
+    steps = lifetimes->min + bench_random(seed) % (lifetimes->max - lifetimes->min + 1);
+    break;
+
+  default:
+    return 0;
+
+  }
+
+  if (steps < 1) {
+    return 1;
+  }
+  return steps < WORKLOAD_MAX_LIFETIME ? steps : WORKLOAD_MAX_LIFETIME;
+
+} // lifetime ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Free the block of a live record and retire the record. */
+static void release (uint32_t index, workload_result_s* result) {
+
+  record_s* record = &records[index];
+
+  if (record->bucket != NONE) {
+    if (record->prev == NONE) {
+      wheel[record->bucket] = record->next;
+    } else {
+      records[record->prev].next = record->next;
+    }
+    if (record->next != NONE) {
+      records[record->next].prev = record->prev;
+    }
+  }
+
+  free(record->block);
+  live_bytes    -= record->size;
+  result->frees += 1;
+
+  // Fill the hole in the live array with its last record.
+  uint32_t last          = live[--live_count];
+  live[record->position] = last;
+  records[last].position = record->position;
+  unused[unused_count++] = index;
+
+} // release ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Free a live block chosen at random. */
+static void release_random (uint64_t* seed, workload_result_s* result) {
+
+  release(live[bench_random(seed) % live_count], result);
+
+} // release_random ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void workload_run (const workload_phase_s* phases, size_t count, uint64_t seed,
+		   workload_result_s* results) {
+
+  // Size the bookkeeping for the largest cap on live blocks.
+  size_t capacity = 0;
+  for (size_t p = 0; p < count; p += 1) {
+    if (phases[p].max_live > capacity) {
+      capacity = phases[p].max_live;
+    }
+  }
+  records = bench_scratch(capacity * sizeof(record_s));
+  unused  = bench_scratch(capacity * sizeof(uint32_t));
+  live    = bench_scratch(capacity * sizeof(uint32_t));
+  wheel   = bench_scratch(WHEEL_BUCKETS * sizeof(uint32_t));
+  for (size_t i = 0; i < capacity; i += 1) {
+    unused[i] = capacity - 1 - i;
+  }
+  unused_count = capacity;
+  memset(wheel, 0xff, WHEEL_BUCKETS * sizeof(uint32_t));
+
+  int      counter = bench_counter_open();
+  uint64_t now     = 0;
+  for (size_t p = 0; p < count; p += 1) {
+
+    const workload_phase_s* phase  = &phases[p];
+    workload_result_s*      result = &results[p];
+    memset(result, 0, sizeof(workload_result_s));
+    result->peak_live_bytes = live_bytes;
+    bench_counter_start(counter);
+    double start = bench_now();
+
+    for (size_t step = 0; step < phase->steps; step += 1) {
+
+      now += 1;
+      uint32_t* dying = &wheel[now % WHEEL_BUCKETS];
+      while (*dying != NONE) {
+	release(*dying, result);
+      }
+
+      if (bench_random(&seed) % 100 >= phase->alloc_percent) {
+	if (live_count > 0) {
+	  release_random(&seed, result);
+	}
+	continue;
+      }
+
+      while (live_count >= phase->max_live) {
+	release_random(&seed, result);
+      }
+
+      uint32_t  index  = unused[--unused_count];
+      record_s* record = &records[index];
+      record->size     = workload_size(&phase->sizes, &seed);
+      record->block    = malloc(record->size);
+      if (record->block != NULL && record->size > 0) {
+	((volatile char*)record->block)[0] = 1;
+      }
+      record->position   = live_count;
+      live[live_count++] = index;
+      live_bytes        += record->size;
+      result->mallocs   += 1;
+      if (live_bytes > result->peak_live_bytes) {
+	result->peak_live_bytes = live_bytes;
+      }
+
+      size_t steps   = lifetime(&phase->lifetimes, &seed);
+      record->bucket = NONE;
+      if (steps > 0) {
+	record->bucket = (now + steps) % WHEEL_BUCKETS;
+	record->prev   = NONE;
+	record->next   = wheel[record->bucket];
+	if (record->next != NONE) {
+	  records[record->next].prev = index;
+	}
+	wheel[record->bucket] = index;
+      }
+
+    }
+
+    // The last phase also pays for freeing whatever remains.
+    if (p == count - 1) {
+      while (live_count > 0) {
+	release(live[live_count - 1], result);
+      }
+    }
+    result->seconds = bench_now() - start;
+    result->misses  = bench_counter_stop(counter);
+
+  }
+  if (counter != -1) {
+    close(counter);
+  }
+
+} // workload_run ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+bool workload_load_histogram (const char* path, workload_sizes_s* sizes) {
+
+  // Read the whole file into scratch space, terminated.
+  int         fd = open(path, O_RDONLY);
+  struct stat info;
+  if (fd == -1 || fstat(fd, &info) == -1) {
+    return false;
+  }
+  char*  text = bench_scratch(info.st_size + 1);
+  size_t got  = 0;
+  while (got < (size_t)info.st_size) {
+    ssize_t n = read(fd, text + got, info.st_size - got);
+    if (n <= 0) {
+      break;
+    }
+    got += n;
+  }
+  close(fd);
+  text[got] = '\0';
+
+  // There can be no more entries than lines.
+  size_t lines = 1;
+  for (size_t i = 0; i < got; i += 1) {
+    lines += (text[i] == '\n');
+  }
+  sizes->bucket_size = bench_scratch(lines * sizeof(size_t));
+  sizes->cumulative  = bench_scratch(lines * sizeof(uint64_t));
+  sizes->buckets     = 0;
+
+  uint64_t total = 0;
+  char*    line  = text;
+  while (*line != '\0') {
+    char*         end;
+    unsigned long size  = strtoul(line, &end, 0);
+    char*         after = end;
+    unsigned long n     = (end != line) ? strtoul(end, &after, 0) : 0;
+    if (after != end && n > 0) {
+      total                              += n;
+      sizes->bucket_size[sizes->buckets]  = size;
+      sizes->cumulative[sizes->buckets]   = total;
+      sizes->buckets                     += 1;
+    }
+    char* newline = strchr(line, '\n');
+    line = (newline != NULL) ? newline + 1 : line + strlen(line);
+  }
+
+  sizes->dist = WORKLOAD_SIZE_EMPIRICAL;
+  return sizes->buckets > 0;
+
+} // workload_load_histogram ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Parse a colon-separated list of numbers.
+ *
+ * \return The number of values parsed, or -1 if there was anything else.
+ */
+static int parse_numbers (const char* text, double* values, int max) {
+
+  int count = 0;
+  while (*text != '\0' && count < max) {
+    char* end;
+    values[count++] = strtod(text, &end);
+    if (end == text || (*end != ':' && *end != '\0')) {
+      return -1;
+    }
+    text = (*end == ':') ? end + 1 : end;
+  }
+  return (*text == '\0') ? count : -1;
+
+} // parse_numbers ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+bool workload_parse_phase (const char* spec, workload_phase_s* phase) {
+
+  memset(phase, 0, sizeof(workload_phase_s));
+  phase->steps         = DEFAULT_STEPS;
+  phase->alloc_percent = DEFAULT_ALLOC_PERCENT;
+  phase->max_live      = WORKLOAD_DEFAULT_MAX_LIVE;
+  phase->sizes.dist    = WORKLOAD_SIZE_UNIFORM;
+  phase->sizes.min     = DEFAULT_MIN_SIZE;
+  phase->sizes.max     = DEFAULT_MAX_SIZE;
+
+  // Split a copy of the description, kept out of the heap under test.
+  char* copy = bench_scratch(strlen(spec) + 1);
+  strcpy(copy, spec);
+
+  char* save;
+  for (char* setting = strtok_r(copy, ",", &save); setting != NULL; setting = strtok_r(NULL, ",", &save)) {
+
+    char* value = strchr(setting, '=');
+    if (value == NULL) {
+      fprintf(stderr, "workload: no value in setting \"%s\"\n", setting);
+      return false;
+    }
+    *value++ = '\0';
+
+    double values[4];
+    int    n   = 0;
+    bool   ok  = true;
+    if (strcmp(setting, "steps") == 0) {
+      ok           = (parse_numbers(value, values, 1) == 1 && values[0] >= 0);
+      phase->steps = ok ? (size_t)values[0] : 0;
+
+    } else if (strcmp(setting, "alloc") == 0) {
+      ok                   = (parse_numbers(value, values, 1) == 1 && values[0] >= 0 && values[0] <= 100);
+      phase->alloc_percent = ok ? (unsigned int)values[0] : 0;
+
+    } else if (strcmp(setting, "live") == 0) {
+      ok              = (parse_numbers(value, values, 1) == 1 && values[0] >= 1 && values[0] < NONE);
+      phase->max_live = ok ? (size_t)values[0] : 0;
+
+    } else if (strncmp(value, "uniform:", 8) == 0 && strcmp(setting, "size") == 0) {
+      ok = (parse_numbers(value + 8, values, 2) == 2 && values[0] <= values[1]);
+      phase->sizes.dist = WORKLOAD_SIZE_UNIFORM;
+      phase->sizes.min  = ok ? (size_t)values[0] : 0;
+      phase->sizes.max  = ok ? (size_t)values[1] : 0;
+
+    } else if (strncmp(value, "lognormal:", 10) == 0 && strcmp(setting, "size") == 0) {
+      n  = parse_numbers(value + 10, values, 4);
+      ok = (n == 2 || (n == 4 && values[2] <= values[3]));
+      phase->sizes.dist  = WORKLOAD_SIZE_LOGNORMAL;
+      phase->sizes.mu    = ok ? values[0] : 0;
+      phase->sizes.sigma = ok ? values[1] : 0;
+      phase->sizes.min   = (ok && n == 4) ? (size_t)values[2] : 1;
+      phase->sizes.max   = (ok && n == 4) ? (size_t)values[3] : ((size_t)1 << 30);
+
+    } else if (strncmp(value, "empirical:", 10) == 0 && strcmp(setting, "size") == 0) {
+      if (!workload_load_histogram(value + 10, &phase->sizes)) {
+	fprintf(stderr, "workload: cannot read a histogram from \"%s\"\n", value + 10);
+	return false;
+      }
+
+    } else if (strcmp(setting, "life") == 0 && strcmp(value, "none") == 0) {
+      phase->lifetimes.dist = WORKLOAD_LIFE_NONE;
+
+    } else if (strcmp(setting, "life") == 0 && strncmp(value, "exp:", 4) == 0) {
+      ok = (parse_numbers(value + 4, values, 1) == 1 && values[0] > 0);
+      phase->lifetimes.dist = WORKLOAD_LIFE_EXPONENTIAL;
+      phase->lifetimes.mean = ok ? values[0] : 0;
+
+    } else if (strcmp(setting, "life") == 0 && strncmp(value, "uniform:", 8) == 0) {
+      ok = (parse_numbers(value + 8, values, 2) == 2 && values[0] <= values[1]);
+      phase->lifetimes.dist = WORKLOAD_LIFE_UNIFORM;
+      phase->lifetimes.min  = ok ? (size_t)values[0] : 0;
+      phase->lifetimes.max  = ok ? (size_t)values[1] : 0;
+
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      fprintf(stderr, "workload: bad setting \"%s=%s\"\n", setting, value);
+      return false;
+    }
+
+  }
+
+  return true;
+
+} // workload_parse_phase ()
+// ==============================================================================
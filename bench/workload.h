@@ -0,0 +1,201 @@
+// ==============================================================================
+/**
+ * workload.h
+ *
+ * A synthetic workload generator for the allocators.  A workload is a sequence
+ * of phases, each of which draws block sizes and lifetimes from its own
+ * distributions, so that a single run can model a program that changes its
+ * behavior over time.  The generator calls `malloc()` and `free()` directly;
+ * which allocator it drives depends only on what it is linked with.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_WORKLOAD_H)
+#define _WORKLOAD_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES
+
+/** The kinds of size distribution. */
+typedef enum workload_size_dist {
+
+  /** Uniform between `min` and `max`. */
+  WORKLOAD_SIZE_UNIFORM = 0,
+
+  /** Log-normal: the natural log of the size is normal with `mu` and `sigma`,
+      clamped to `min` and `max`. */
+  WORKLOAD_SIZE_LOGNORMAL,
+
+  /** Drawn from a histogram of sizes and their counts. */
+  WORKLOAD_SIZE_EMPIRICAL
+
+} workload_size_dist_e;
+
+/** A distribution of block sizes. */
+typedef struct workload_sizes {
+
+  workload_size_dist_e dist;
+  size_t               min;
+  size_t               max;
+  double               mu;
+  double               sigma;
+
+  /** For an empirical distribution, the sizes and the running totals of their
+      counts, so that `cumulative[buckets - 1]` is the total count. */
+  size_t               buckets;
+  size_t*              bucket_size;
+  uint64_t*            cumulative;
+
+} workload_sizes_s;
+
+/** The kinds of lifetime distribution. */
+typedef enum workload_life_dist {
+
+  /** No set lifetime: a block lives until it is picked, at random, by a free
+      operation or to make room under the phase's cap on live blocks. */
+  WORKLOAD_LIFE_NONE = 0,
+
+  /** Exponential with the given `mean`, in operations. */
+  WORKLOAD_LIFE_EXPONENTIAL,
+
+  /** Uniform between `min` and `max` operations. */
+  WORKLOAD_LIFE_UNIFORM
+
+} workload_life_dist_e;
+
+/** A distribution of block lifetimes, measured in the phase's steps. */
+typedef struct workload_lifetimes {
+
+  workload_life_dist_e dist;
+  double               mean;
+  size_t               min;
+  size_t               max;
+
+} workload_lifetimes_s;
+
+/** One phase of a workload. */
+typedef struct workload_phase {
+
+  /** The number of steps in the phase. */
+  size_t               steps;
+
+  /** The percentage of steps that allocate a block; the rest free one chosen at
+      random.  Blocks whose lifetimes end are freed in addition. */
+  unsigned int         alloc_percent;
+
+  /** The most blocks live at once; at the cap, an allocating step first frees
+      a block chosen at random. */
+  size_t               max_live;
+
+  workload_sizes_s     sizes;
+  workload_lifetimes_s lifetimes;
+
+} workload_phase_s;
+
+/** What a phase did. */
+typedef struct workload_result {
+
+  uint64_t mallocs;
+  uint64_t frees;
+  double   seconds;
+
+  /** The cache misses counted, or `BENCH_NO_COUNT`. */
+  uint64_t misses;
+
+  /** The most bytes requested and live at once during the phase. */
+  size_t   peak_live_bytes;
+
+} workload_result_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The longest lifetime representable, in steps; longer ones are cut short. */
+#define WORKLOAD_MAX_LIFETIME (1 << 20)
+
+/** The cap on live blocks for a phase that does not set one. */
+#define WORKLOAD_DEFAULT_MAX_LIVE 100000
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Parse a phase from its description, a comma-separated list of settings:
+ *
+ *   steps=<n>                          (default 1000000)
+ *   alloc=<percent>                    (default 50)
+ *   live=<n>                           (default WORKLOAD_DEFAULT_MAX_LIVE)
+ *   size=uniform:<min>:<max>           (default uniform:16:2048)
+ *   size=lognormal:<mu>:<sigma>[:<min>:<max>]
+ *   size=empirical:<file>
+ *   life=none | exp:<mean> | uniform:<min>:<max>     (default none)
+ *
+ * A histogram file holds one `<size> <count>` pair per line.
+ *
+ * \param spec  The description.
+ * \param phase The phase to fill in.
+ * \return      Whether the description was valid; if not, a message has been
+ *              written to `stderr`.
+ */
+bool workload_parse_phase (const char* spec, workload_phase_s* phase);
+
+/**
+ * Load an empirical size distribution from a histogram file.
+ *
+ * \param path  The file, with one `<size> <count>` pair per line.
+ * \param sizes The distribution to fill in.
+ * \return      Whether the file could be read and held at least one size.
+ */
+bool workload_load_histogram (const char* path, workload_sizes_s* sizes);
+
+/**
+ * Draw a size from a distribution.
+ *
+ * \param sizes The distribution.
+ * \param seed  The state of the random number generator.
+ * \return      The size.
+ */
+size_t workload_size (const workload_sizes_s* sizes, uint64_t* seed);
+
+/**
+ * Run a workload: each phase in turn, carrying the blocks left live by one
+ * phase into the next, and then free whatever remains.  The generator's own
+ * bookkeeping is kept in scratch space outside the allocator, and choosing a
+ * block to free takes constant time.
+ *
+ * \param phases  The phases.
+ * \param count   The number of phases.
+ * \param seed    A non-zero seed for the random number generator.
+ * \param results Where to store what each of the phases did.
+ */
+void workload_run (const workload_phase_s* phases, size_t count, uint64_t seed,
+		   workload_result_s* results);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _WORKLOAD_H
+// ==============================================================================
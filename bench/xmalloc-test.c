@@ -0,0 +1,113 @@
+// ==============================================================================
+/**
+ * xmalloc-test.c
+ *
+ * The xmalloc producer/consumer benchmark: producer threads allocate batches
+ * of small blocks and pass them through a shared queue to consumer threads,
+ * which free them.  Every block is thus freed by a thread other than the one
+ * that allocated it.
+ *
+ * Neither allocator is thread-safe, so the producers and consumers here are
+ * logical threads, taking turns batch by batch on a single OS thread.
+ *
+ * Built and run by `bench/run`; by hand, for example:
+ *
+ *   gcc -O2 -fno-builtin -o xmalloc-test-bf bench/xmalloc-test.c bench/bench.c \
+ *       bf-alloc.c safeio.c allocconf.c
+ *
+ * Output is one row of the suite's CSV report.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+#define DEFAULT_THREADS 4
+#define BATCH           100
+#define QUEUE_BATCHES   64
+#define MIN_SIZE        8
+#define MAX_SIZE        128
+#define BATCHES         10000
+// ==============================================================================
+
+
+
+// ==============================================================================
+int main (int argc, char** argv) {
+
+  size_t threads = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_THREADS;
+  if (threads == 0) {
+    fprintf(stderr, "USAGE: %s [<producer/consumer pairs>]\n", argv[0]);
+    return 1;
+  }
+
+  // The queue holds whole batches; it is a ring of batch slots.
+  void**   queue = bench_scratch(QUEUE_BATCHES * BATCH * sizeof(void*));
+  size_t   head  = 0;
+  size_t   tail  = 0;
+  uint64_t seed  = 1;
+
+  int counter = bench_counter_open();
+  bench_counter_start(counter);
+  double start = bench_now();
+
+  uint64_t ops = 0;
+  for (size_t produced = 0; produced < BATCHES; ) {
+
+    // Each producer in turn fills a batch, if there is room in the queue...
+    for (size_t p = 0; p < threads && produced < BATCHES && head - tail < QUEUE_BATCHES; p += 1) {
+      void** batch = &queue[(head % QUEUE_BATCHES) * BATCH];
+      for (size_t i = 0; i < BATCH; i += 1) {
+	size_t size = MIN_SIZE + bench_random(&seed) % (MAX_SIZE - MIN_SIZE + 1);
+	char*  block = malloc(size);
+	block[0]     = (char)p;
+	batch[i]     = block;
+      }
+      head     += 1;
+      produced += 1;
+      ops      += BATCH;
+    }
+
+    // ...and each consumer in turn empties one.
+    for (size_t c = 0; c < threads && tail < head; c += 1) {
+      void** batch = &queue[(tail % QUEUE_BATCHES) * BATCH];
+      for (size_t i = 0; i < BATCH; i += 1) {
+	free(batch[i]);
+      }
+      tail += 1;
+      ops  += BATCH;
+    }
+
+  }
+  while (tail < head) {
+    void** batch = &queue[(tail % QUEUE_BATCHES) * BATCH];
+    for (size_t i = 0; i < BATCH; i += 1) {
+      free(batch[i]);
+    }
+    tail += 1;
+    ops  += BATCH;
+  }
+
+  double   seconds = bench_now() - start;
+  uint64_t misses  = bench_counter_stop(counter);
+
+  char config[64];
+  snprintf(config, sizeof(config), "threads=%zu", threads);
+  bench_report("xmalloc-test", config, ops, seconds, misses);
+  return 0;
+
+} // main ()
+// ==============================================================================
@@ -6,6 +6,36 @@
  * from which to allocate the best fitting free block.  If the list does not
  * contain any blocks of sufficient size, it uses _pointer bumping_ to expand
  * the heap.
+ *
+ * The heap size, the fit policy, and whether large requests are mapped on their
+ * own can be set at runtime through `BFALLOC_CONF`; see allocconf.h.
+ *
+ * If compiled with `GUARD_POOL`, a sample of allocations is served from a pool
+ * of guard pages instead, to catch overflows and uses after free; see
+ * guardpool.h.
+ *
+ * If compiled with `NUMA_AWARE`, the heap and large blocks can be placed on a
+ * chosen NUMA node; see numabind.h.
+ *
+ * If compiled with `PERSISTENT_HEAP`, headers are linked by their offsets from
+ * the start of the heap rather than by their addresses, and the heap begins
+ * with a _superblock_ that records how far it has been bumped into, where its
+ * lists begin, and a root block from which an application can find its data
+ * again.  With `persist:<path>` in `BFALLOC_CONF`, the heap is then kept in a
+ * file (see heapfile.h), and reopening the file restores every block and both
+ * lists.  If the process died without closing the heap, the lists are rebuilt
+ * by walking it instead.  With `persist_sync:on`, each header is flushed to the
+ * file before the heap is bumped past it, so that a walk survives a crash of
+ * the machine as well.  Large blocks are not mapped on their own, nor are any
+ * guarded, in a heap kept in a file; arenas link their chunks by address, and
+ * do not survive the file being mapped elsewhere.
+ *
+ * With `shared:<name>` instead, the heap is shared by every process that opens
+ * it, and each operation on it holds a process-shared lock kept in the
+ * superblock, reading the lists from the superblock as it takes the lock and
+ * writing them back as it lets go.  The processes can then hand blocks to
+ * each other as offsets (see `malloc_offset()`).  If a process dies holding
+ * the lock, the next to take it rebuilds the lists by walking the heap.
  **/
 // ==============================================================================
 
@@ -15,6 +45,9 @@
 // INCLUDES
 
 #include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -23,6 +56,14 @@
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include "alloc.h"
+#include "allocconf.h"
+#include "alloctrace.h"
+#include "guardpool.h"
+#include "heapfile.h"
+#include "heapprof.h"
+#include "latency.h"
+#include "numabind.h"
 #include "safeio.h"
 // ==============================================================================
 
@@ -31,22 +72,105 @@
 // ==============================================================================
 // TYPES AND STRUCTURES
 
+/** A link to a header: its offset in the heap, or its address. */
+#if defined (PERSISTENT_HEAP)
+typedef size_t link_t;
+#else
+typedef struct header* link_t;
+#endif /* PERSISTENT_HEAP */
+
 /** The header for each allocated object. */
 typedef struct header {
 
-  /** Pointer to the next header in the list. */
-  struct header* next;
+  /** Link to the next header in the list. */
+  link_t next;
 
-  /** Pointer to the previous header in the list. */
-  struct header* prev;
+  /** Link to the previous header in the list. */
+  link_t prev;
 
   /** The usable size of the block (exclusive of the header itself). */
-  size_t         size;
+  size_t size;
 
   /** Is the block allocated or free? */
-  bool           allocated;
+  bool   allocated;
 
 } header_s;
+
+#if defined (PERSISTENT_HEAP)
+/** The start of the heap, holding what is needed to reopen it. */
+typedef struct superblock {
+
+  /** The header of the heap file, if the heap is kept in one. */
+  heapfile_header_s file;
+
+  /** The offset of the first byte not yet bumped into. */
+  size_t            used;
+
+  /** The heads of the free and allocated lists... */
+  link_t            free_list_head;
+  link_t            alloc_list_head;
+
+  /** ...and the blocks on the latter, and the bytes they span... */
+  size_t            live_blocks;
+  size_t            live_bytes;
+
+  /** ...as of the last time the heap was closed, if `clean`. */
+  bool              clean;
+
+  /** The offset of the application's root block, or 0 for none. */
+  size_t            root;
+
+  /** The lock held by each operation on a shared heap. */
+  pthread_mutex_t   lock;
+
+} superblock_s;
+#endif /* PERSISTENT_HEAP */
+
+/** The header at the start of each arena chunk. */
+typedef struct arena_chunk {
+
+  /** The chunk allocated before this one, or `NULL` for the first chunk. */
+  struct arena_chunk* prev;
+
+  /** The end of the chunk. */
+  intptr_t            limit;
+
+} arena_chunk_s;
+
+/** An arena, which lives at the start of its first chunk. */
+struct arena {
+
+  /** The chunk from which blocks are currently being allocated. */
+  arena_chunk_s* current;
+
+  /** The next free byte in the current chunk. */
+  intptr_t       cursor;
+
+  /** The end of the current chunk. */
+  intptr_t       limit;
+
+  /** The size of each new chunk. */
+  size_t         chunk_size;
+
+};
+
+/** The number of characters in each line of the fragmentation map... */
+#define FRAG_MAP_COLUMNS 64
+
+/** ...and the most characters in the map. */
+#define FRAG_MAP_CELLS (FRAG_MAP_COLUMNS * 32)
+
+/** The live and free bytes falling in each cell of the fragmentation map. */
+typedef struct frag_map {
+
+  /** The number of bytes of heap covered by each cell. */
+  size_t cell_size;
+
+  /** The bytes of allocated and of free blocks in each cell. */
+  size_t live[FRAG_MAP_CELLS];
+  size_t free[FRAG_MAP_CELLS];
+
+} frag_map_s;
 // ==============================================================================
 
 
@@ -65,20 +189,126 @@ typedef struct header {
 #define MB(size)  (KB(size) * 1024)
 #define GB(size)  (MB(size) * 1024)
 
-/** The virtual address space reserved for the heap. */
-#define HEAP_SIZE GB(2)
+/** The virtual address space reserved for the heap, configured at initialization. */
+#define HEAP_SIZE conf.heap_size
+
+/** The heap size used unless configured otherwise. */
+#define DEFAULT_HEAP_SIZE GB(2)
+
+/** Requests larger than this are mapped on their own; 0 means none are. */
+#define MMAP_THRESHOLD conf.mmap_threshold
+
+/** Round a length up to whole pages. */
+#define ROUND_TO_PAGES(x) (((size_t)(x) + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1))
 
 /** Given a pointer to a header, obtain a `void*` pointer to the block itself. */
 #define HEADER_TO_BLOCK(hp) ((void*)((intptr_t)hp + sizeof(header_s)))
 
 /** Given a pointer to a block, obtain a `header_s*` pointer to its header. */
 #define BLOCK_TO_HEADER(bp) ((header_s*)((intptr_t)bp - sizeof(header_s)))
+
+/** The alignment of every block. */
+#define BLOCK_ALIGNMENT 16
+
+/** Round a block size up so that a header placed right after it is aligned. */
+#define ROUND_TO_ALIGNMENT(x) (((x) + BLOCK_ALIGNMENT - 1) & ~(size_t)(BLOCK_ALIGNMENT - 1))
+
+/** The default size of each arena chunk. */
+#define ARENA_CHUNK_SIZE KB(64)
+
+/** The space at the start of an arena chunk taken by its header. */
+#define ARENA_CHUNK_HEADER ROUND_TO_ALIGNMENT(sizeof(arena_chunk_s))
+
+/** The space at the start of an arena's first chunk taken by the arena itself. */
+#define ARENA_HEADER (ARENA_CHUNK_HEADER + ROUND_TO_ALIGNMENT(sizeof(arena_s)))
+
+/**
+ * Convert between a header and a link to it.  With offsets, the superblock
+ * sits at offset 0, so no header ever does, and 0 means no link.
+ */
+#if defined (PERSISTENT_HEAP)
+#define NO_LINK   ((link_t)0)
+#define LINK(hp)  ((hp) == NULL ? NO_LINK : (link_t)((intptr_t)(hp) - start_addr))
+#define HEADER(l) ((l) == NO_LINK ? NULL : (header_s*)(start_addr + (intptr_t)(l)))
+#else
+#define NO_LINK   NULL
+#define LINK(hp)  (hp)
+#define HEADER(l) (l)
+#endif /* PERSISTENT_HEAP */
+
+/** The space at the start of the heap taken by the superblock, if any. */
+#if defined (PERSISTENT_HEAP)
+#define SUPERBLOCK_SIZE ROUND_TO_ALIGNMENT(sizeof(superblock_s))
+#else
+#define SUPERBLOCK_SIZE 0
+#endif /* PERSISTENT_HEAP */
+
+/** The layout of a heap file, which must match for the file to be reopened. */
+#define HEAP_LAYOUT (((uint64_t)sizeof(superblock_s) << 32) | sizeof(header_s))
+
+/**
+ * Flush a range of a heap kept in a file, if so configured (or, if disabled,
+ * nothing).  Bumping then records the new end of the heap in the superblock,
+ * after the headers before it are in place.
+ */
+#if defined (PERSISTENT_HEAP)
+#define PERSIST_SYNC(addr, length)					\
+  do {									\
+    if (conf.persist_sync) {						\
+      heapfile_sync((addr), (length));					\
+    }									\
+  } while (0)
+#define PERSIST_BUMP()							\
+  do {									\
+    superblock->used = free_addr - start_addr;				\
+    PERSIST_SYNC(&superblock->used, sizeof(superblock->used));		\
+  } while (0)
+#else
+#define PERSIST_SYNC(addr, length)
+#define PERSIST_BUMP()
+#endif /* PERSISTENT_HEAP */
+
+/** Is the heap shared with other processes? */
+#define SHARED_HEAP (conf.shared_name[0] != '\0')
+
+/** Take and let go of the lock of a shared heap (or, if disabled, nothing). */
+#if defined (PERSISTENT_HEAP)
+#define HEAP_LOCK()							\
+  do {									\
+    if (SHARED_HEAP) {							\
+      heap_lock();							\
+    }									\
+  } while (0)
+#define HEAP_UNLOCK()							\
+  do {									\
+    if (SHARED_HEAP) {							\
+      heap_unlock();							\
+    }									\
+  } while (0)
+#else
+#define HEAP_LOCK()
+#define HEAP_UNLOCK()
+#endif /* PERSISTENT_HEAP */
 // ==============================================================================
 
 
 // ==============================================================================
 // GLOBALS
 
+/** The runtime settings, read from `BFALLOC_CONF` at initialization. */
+static alloc_conf_s conf = { .heap_size      = DEFAULT_HEAP_SIZE,
+			      .mmap_threshold = 0,
+			      .thp            = ALLOC_THP_DEFAULT,
+			      .stats          = false,
+			      .fit            = ALLOC_FIT_BEST,
+			      .guard_rate     = GUARDPOOL_DEFAULT_RATE,
+			      .cacheline      = false,
+			      .color          = false,
+			      .numa_node      = ALLOC_NUMA_OFF,
+			      .persist_sync   = false,
+			      .persist_path   = "",
+			      .shared_name    = "" };
+
 /** The address of the next available byte in the heap region. */
 static intptr_t free_addr  = 0;
 
@@ -93,6 +323,237 @@ static header_s* free_list_head = NULL;
 
 /** The head of the allocated list. */
 static header_s* alloc_list_head = NULL;
+
+#if defined (PERSISTENT_HEAP)
+/** The superblock, at the start of the heap. */
+static superblock_s* superblock = NULL;
+
+/** How many times over this process holds the lock of a shared heap. */
+static unsigned int  lock_depth = 0;
+
+/** The descriptor of a shared heap in a memfd, or -1. */
+static int           shared_fd  = -1;
+#else
+/** The application's root block. */
+static void* root = NULL;
+#endif /* PERSISTENT_HEAP */
+
+/** The number of blocks ever allocated and freed. */
+static size_t total_allocations = 0;
+static size_t total_frees       = 0;
+
+/** The bytes ever requested, and the bytes ever handed out to satisfy them. */
+static size_t total_requested   = 0;
+static size_t total_allocated   = 0;
+
+/** The number of blocks on the allocated list, and the bytes they span. */
+static size_t live_blocks       = 0;
+static size_t live_bytes        = 0;
+
+/** The number of blocks mapped outside of the heap, and the bytes they span. */
+static size_t large_mappings    = 0;
+static size_t large_bytes       = 0;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Visit each block of the heap in address order.  Every header starts on a
+ * `BLOCK_ALIGNMENT` boundary, so the next header follows the end of each block
+ * after at most that much padding.
+ *
+ * \param visit   The function to call with each header and the padding that
+ *                follows its block.
+ * \param context Passed through to `visit`.
+ */
+static void walk_heap (void (*visit) (header_s*, size_t, void*), void* context) {
+
+  intptr_t current = start_addr + SUPERBLOCK_SIZE;
+  while (current < free_addr) {
+
+    header_s* header    = (header_s*)current;
+    intptr_t  block_end = (intptr_t)HEADER_TO_BLOCK(header) + header->size;
+    if (block_end > free_addr || block_end < current) {
+      ERROR("walk_heap(): Block overruns the heap", current, header->size);
+    }
+
+    // the last block ends exactly at free_addr, with no padding after it
+    intptr_t next = (block_end == free_addr) ? block_end : (intptr_t)ROUND_TO_ALIGNMENT((size_t)block_end);
+    visit(header, next - block_end, context);
+    current = next;
+
+  }
+
+} // walk_heap ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+#if defined (PERSISTENT_HEAP)
+/**
+ * Put one block back on its list, while rebuilding the lists by walking the
+ * heap.
+ *
+ * \param header  The block's header.
+ * \param padding Unused.
+ * \param context Unused.
+ */
+static void relink_visit (header_s* header, size_t padding, void* context) {
+
+  (void)padding;
+  (void)context;
+  header_s** head = header->allocated ? &alloc_list_head : &free_list_head;
+  header->prev    = NO_LINK;
+  header->next    = LINK(*head);
+  if (*head != NULL) {
+    (*head)->prev = LINK(header);
+  }
+  *head = header;
+
+  if (header->allocated) {
+    live_blocks += 1;
+    live_bytes  += header->size;
+  }
+
+} // relink_visit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Rebuild both lists, and the counts of live blocks, from the blocks of the
+ * heap themselves.
+ */
+static void rebuild_lists () {
+
+  free_list_head  = NULL;
+  alloc_list_head = NULL;
+  live_blocks     = 0;
+  live_bytes      = 0;
+  walk_heap(relink_visit, NULL);
+
+} // rebuild_lists ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the heap's lists through its superblock, formatting it first if the heap
+ * is new.  If the heap was not closed cleanly, the lists saved in the
+ * superblock are stale, and are rebuilt from the blocks themselves; their
+ * headers are up to date, as is the extent of the heap.
+ *
+ * \param created Is the heap new?
+ */
+static void open_superblock (bool created) {
+
+  // the heap is only closed at exit once it has been opened in full
+  superblock_s* opening = (superblock_s*)start_addr;
+  if (created) {
+    opening->file.version = HEAP_LAYOUT;
+    opening->used         = SUPERBLOCK_SIZE;
+    opening->clean        = true;
+    if (SHARED_HEAP) {
+      pthread_mutexattr_t attributes;
+      pthread_mutexattr_init(&attributes);
+      pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+      pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+      pthread_mutex_init(&opening->lock, &attributes);
+      pthread_mutexattr_destroy(&attributes);
+    }
+    PERSIST_SYNC(opening, sizeof(superblock_s));
+    __atomic_store_n(&opening->file.magic, HEAPFILE_MAGIC, __ATOMIC_RELEASE);  // only now is the file a heap
+  }
+
+  // a shared heap's lists are read afresh each time its lock is taken
+  if (SHARED_HEAP) {
+    superblock = opening;
+    return;
+  }
+
+  free_addr = start_addr + opening->used;
+  if (free_addr < start_addr + (intptr_t)SUPERBLOCK_SIZE || free_addr > end_addr) {
+    ERROR("open_superblock(): Heap extent is corrupt", opening->used);
+  }
+  if (opening->clean) {
+    free_list_head  = HEADER(opening->free_list_head);
+    alloc_list_head = HEADER(opening->alloc_list_head);
+    live_blocks     = opening->live_blocks;
+    live_bytes      = opening->live_bytes;
+  } else {
+    DEBUG("Heap was not closed cleanly; rebuilding its lists");
+    rebuild_lists();
+  }
+
+  // until the heap is closed again, the lists saved in it are stale
+  opening->clean = false;
+  PERSIST_SYNC(opening, sizeof(superblock_s));
+  superblock = opening;
+
+} // open_superblock ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take the lock of a shared heap, and, unless this process already holds it,
+ * read the heap's extent and lists from the superblock.  If the lock's last
+ * holder died, whatever it was doing is left half-done in the headers, so the
+ * lists are rebuilt from them instead.
+ */
+static void heap_lock () {
+
+  int result = pthread_mutex_lock(&superblock->lock);
+  if (result != 0 && result != EOWNERDEAD) {
+    ERROR("heap_lock(): Could not lock shared heap", result);
+  }
+  lock_depth += 1;
+  if (lock_depth > 1) {
+    return;
+  }
+
+  free_addr = start_addr + superblock->used;
+  if (result == EOWNERDEAD) {
+    DEBUG("Shared heap's last holder died; rebuilding its lists");
+    rebuild_lists();
+    pthread_mutex_consistent(&superblock->lock);
+    return;
+  }
+  free_list_head  = HEADER(superblock->free_list_head);
+  alloc_list_head = HEADER(superblock->alloc_list_head);
+  live_blocks     = superblock->live_blocks;
+  live_bytes      = superblock->live_bytes;
+
+} // heap_lock ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Let go of the lock of a shared heap, first writing the heap's extent and
+ * lists back to the superblock if this process is done with it.
+ */
+static void heap_unlock () {
+
+  lock_depth -= 1;
+  if (lock_depth == 0) {
+    superblock->used            = free_addr - start_addr;
+    superblock->free_list_head  = LINK(free_list_head);
+    superblock->alloc_list_head = LINK(alloc_list_head);
+    superblock->live_blocks     = live_blocks;
+    superblock->live_bytes      = live_bytes;
+  }
+  pthread_mutex_unlock(&superblock->lock);
+
+} // heap_unlock ()
+#endif /* PERSISTENT_HEAP */
 // ==============================================================================
 
 
@@ -108,24 +569,78 @@ void init () {
   if (start_addr == 0) {
 
     DEBUG("Trying to initialize");
+
+    // Read the runtime settings.
+    unsigned int accepted = (ALLOCCONF_HEAP_SIZE | ALLOCCONF_MMAP_THRESHOLD | ALLOCCONF_THP |
+			     ALLOCCONF_STATS | ALLOCCONF_FIT);
+#if defined (GUARD_POOL)
+    accepted |= ALLOCCONF_GUARD_RATE;
+#endif
+#if defined (NUMA_AWARE)
+    accepted |= ALLOCCONF_NUMA;
+#endif
+#if defined (PERSISTENT_HEAP)
+    accepted |= ALLOCCONF_PERSIST | ALLOCCONF_SHARED;
+#endif
+    allocconf_load("BFALLOC_CONF", accepted, &conf);
+#if defined (PERSISTENT_HEAP)
+    if (SHARED_HEAP) {
+      conf.persist_path[0] = '\0';
+      conf.mmap_threshold  = 0;
+      conf.guard_rate      = 0;
+      conf.persist_sync    = false;
+    } else if (conf.persist_path[0] != '\0') {
+      // every block of a heap kept in a file must lie within the file
+      conf.mmap_threshold = 0;
+      conf.guard_rate     = 0;
+    } else {
+      conf.persist_sync   = false;
+    }
+#endif
+#if defined (GUARD_POOL)
+    guardpool_set_rate(conf.guard_rate);
+#endif
+    conf.heap_size = ROUND_TO_PAGES(conf.heap_size);
+    conf.numa_node = NUMABIND_RESOLVE(conf.numa_node);
     
-    // Allocate virtual address space in which the heap will reside. Make it
-    // un-shared and not backed by any file (_anonymous_ space).  A failure to
-    // map this space is fatal.
-    void* heap = mmap(NULL,
-		      HEAP_SIZE,
-		      PROT_READ | PROT_WRITE,
-		      MAP_PRIVATE | MAP_ANONYMOUS,
-		      -1,
-		      0);
-    if (heap == MAP_FAILED) {
-      ERROR("Could not mmap() heap region");
+    // Allocate virtual address space in which the heap will reside.  Unless it
+    // is to be kept in a file, make it un-shared and not backed by any file
+    // (_anonymous_ space).  A failure to map this space is fatal.
+    void* heap = NULL;
+#if defined (PERSISTENT_HEAP)
+    bool created = true;
+    if (SHARED_HEAP) {
+      heap = heapfile_open_shared(conf.shared_name, HEAP_SIZE, HEAP_LAYOUT, &created, &shared_fd);
+    } else if (conf.persist_path[0] != '\0') {
+      heap = heapfile_open(conf.persist_path, HEAP_SIZE, HEAP_LAYOUT, &created);
+    }
+    if (heap != NULL) {
+      conf.heap_size = ((heapfile_header_s*)heap)->size;  // a file keeps its own size
+    }
+#endif
+    if (heap == NULL) {
+      heap = mmap(NULL,
+		  HEAP_SIZE,
+		  PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS,
+		  -1,
+		  0);
+      if (heap == MAP_FAILED) {
+	ERROR("Could not mmap() heap region");
+      }
+    }
+    NUMABIND_BIND(heap, HEAP_SIZE, conf.numa_node);
+    if (conf.thp != ALLOC_THP_DEFAULT) {
+      madvise(heap, HEAP_SIZE, conf.thp == ALLOC_THP_ON ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
     }
 
     // Hold onto the boundaries of the heap as a whole.
     start_addr = (intptr_t)heap;
     end_addr   = start_addr + HEAP_SIZE;
-    free_addr  = start_addr;
+    free_addr  = start_addr + SUPERBLOCK_SIZE;
+#if defined (PERSISTENT_HEAP)
+    open_superblock(created);
+#endif
 
     // DEBUG: Emit a message to indicate that this allocator is being called.
     DEBUG("bf-alloc initialized");
@@ -136,6 +651,72 @@ void init () {
 // ==============================================================================
 
 
+// ==============================================================================
+/**
+ * Allocate a block in a mapping of its own, outside of the heap.  It has a
+ * header like any other block, but is on neither list, and its usable size is
+ * whatever the whole pages leave after the header.
+ *
+ * \param size The number of bytes to allocate.
+ * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ */
+static void* map_alloc (size_t size) {
+
+  size_t length = ROUND_TO_PAGES(sizeof(header_s) + size);
+  if (length < size) {
+    return NULL;
+  }
+  void* region = mmap(NULL,
+		      length,
+		      PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS,
+		      -1,
+		      0);
+  if (region == MAP_FAILED) {
+    DEBUG("Could not mmap() large block", size);
+    return NULL;
+  }
+  NUMABIND_BIND(region, length, conf.numa_node);
+
+  header_s* header_ptr  = region;
+  header_ptr->next      = NO_LINK;
+  header_ptr->prev      = NO_LINK;
+  header_ptr->size      = length - sizeof(header_s);
+  header_ptr->allocated = true;
+
+  total_allocations += 1;
+  total_requested   += size;
+  total_allocated   += header_ptr->size;
+  large_mappings    += 1;
+  large_bytes       += length;
+  return HEADER_TO_BLOCK(header_ptr);
+
+} // map_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Unmap a block allocated by `map_alloc()`.
+ *
+ * \param header_ptr The block's header.
+ */
+static void map_free (header_s* header_ptr) {
+
+  size_t length = sizeof(header_s) + header_ptr->size;
+  total_frees    += 1;
+  large_mappings -= 1;
+  large_bytes    -= length;
+  if (munmap(header_ptr, length) == -1) {
+    ERROR("Could not unmap large block", (intptr_t)header_ptr);
+  }
+
+} // map_free ()
+// ==============================================================================
+
+
+
 // ==============================================================================
 /**
  * Allocate and return `size` bytes of heap space.  Specifically, search the
@@ -154,6 +735,27 @@ void* malloc (size_t size) {
     return NULL;
   }
 
+  // maybe take this one as a guarded sample
+  void* guarded_ptr = GUARDPOOL_MALLOC(size);
+  if (guarded_ptr != NULL) {
+    HEAPPROF_MALLOC(guarded_ptr, size);
+    ALLOCTRACE(ALLOCTRACE_MALLOC, guarded_ptr, size, NULL);
+    return guarded_ptr;
+  }
+
+  LATENCY_BEGIN(LATENCY_BUMP); // time it, as a bump unless the free list has a fit
+
+  // map the request on its own if it is over the threshold
+  if (MMAP_THRESHOLD != 0 && size > MMAP_THRESHOLD) {
+    LATENCY_PATH(LATENCY_MMAP);
+    void* block_ptr = map_alloc(size);
+    HEAPPROF_MALLOC(block_ptr, size);
+    ALLOCTRACE(ALLOCTRACE_MALLOC, block_ptr, size, NULL);
+    LATENCY_END();
+    return block_ptr;
+  }
+
+  HEAP_LOCK();
   header_s* current = free_list_head;  // pointer to the free block list
   header_s* best    = NULL;  // pointer to our best-fit block
 
@@ -175,13 +777,13 @@ void* malloc (size_t size) {
       best = current;  // ... then set the current block as the best-fit block
     }
 
-    // if our best-fit block is exactly the size we need, exit from the loop
-    if (best != NULL && best->size == size) {
+    // if our best-fit block is exactly the size we need (or any fit will do), exit from the loop
+    if (best != NULL && (best->size == size || conf.fit == ALLOC_FIT_FIRST)) {
       break;
     }
 
     // proceed to next free block in the list
-    current = current->next;
+    current = HEADER(current->next);
     
   }
 
@@ -192,21 +794,23 @@ void* malloc (size_t size) {
    ***************************************/  
   if (best != NULL) {
 
+    LATENCY_PATH(LATENCY_FREE_LIST_HIT);
+
     /****************************************
      * Remove our best-fit block from the 
      * free block list
      ***************************************/
     
     // if our best-fit block was the first block in our free block list
-    if (best->prev == NULL) {
-      free_list_head   = best->next;  // ... then make the next free block the new first element in our free block list
+    if (best->prev == NO_LINK) {
+      free_list_head   = HEADER(best->next);  // ... then make the next free block the new first element in our free block list
     } else {
-      best->prev->next = best->next; // ...otherwise, the previous free block's 'next' pointer will point to our best-fit block's 'next' free block address
+      HEADER(best->prev)->next = best->next; // ...otherwise, the previous free block's 'next' pointer will point to our best-fit block's 'next' free block address
     }
 
     // if our best-fit block was not the last block in the free block list
-    if (best->next != NULL) {
-      best->next->prev = best->prev; // ...then the next free block's 'prev' pointer will point to our best-fit block's 'prev' address
+    if (best->next != NO_LINK) {
+      HEADER(best->next)->prev = best->prev; // ...then the next free block's 'prev' pointer will point to our best-fit block's 'prev' address
     }
     
     /****************************************
@@ -214,16 +818,17 @@ void* malloc (size_t size) {
      * allocated block list
      ***************************************/
 
-    best->next = alloc_list_head; // set our best-fit block's 'next' pointer to point to first element in our allocated block list
+    best->next = LINK(alloc_list_head); // set our best-fit block's 'next' pointer to point to first element in our allocated block list
     alloc_list_head  = best;  //  our allocated block list pointer will now point to our best-fit block's header
-    best->prev = NULL; // set our best-fit block's 'prev' point to null, as it will be the first item in the allocated block list
+    best->prev = NO_LINK; // set our best-fit block's 'prev' point to null, as it will be the first item in the allocated block list
 
     // if there was already a block in the allocated block list
-    if (best->next != NULL) {
-      best->next->prev = best;  // ...then set that allocated block's 'prev' pointer to point back to our best-fit block
+    if (best->next != NO_LINK) {
+      HEADER(best->next)->prev = LINK(best);  // ...then set that allocated block's 'prev' pointer to point back to our best-fit block
     }
 
     best->allocated = true; // mark our best-fit block as allocated
+    PERSIST_SYNC(best, sizeof(header_s));
     
     new_block_ptr   = HEADER_TO_BLOCK(best); // our new block pointer will point to our new best-fit block
 
@@ -245,37 +850,50 @@ void* malloc (size_t size) {
     header_s* header_ptr = (header_s*)free_addr;  // our new block header will begin at free_addr
     new_block_ptr = HEADER_TO_BLOCK(header_ptr);  // our pointer to the beginnign of our block
 
+    intptr_t new_free_addr = (intptr_t)new_block_ptr + size; // update the new free address pointer
+
+    // if the new block goes beyond our heap, return NULL before linking it anywhere
+    if (new_free_addr > end_addr || new_free_addr < free_addr) {
+      HEAP_UNLOCK();
+      LATENCY_END();
+      return NULL;
+    }
+
      /****************************************
      * Add our new block to the allocated 
      *   block list
      ***************************************/
 
-    header_ptr->next      = alloc_list_head;  // set our new block's 'next' pointer to point to first element in the allocated block list
+    header_ptr->next      = LINK(alloc_list_head);  // set our new block's 'next' pointer to point to first element in the allocated block list
     alloc_list_head       = header_ptr; // our allocated block list pointer will now point to this block
-    header_ptr->prev      = NULL;  // set our new block's 'prev' pointer to null, as this will be our first block in the allocated block list
+    header_ptr->prev      = NO_LINK;  // set our new block's 'prev' pointer to null, as this will be our first block in the allocated block list
     header_ptr->size      = size;  // set the size value to our requested block size
     header_ptr->allocated = true;  // mark this block as allocated
 
     // if there was already a block in the allocated block list
-    if (header_ptr->next != NULL) {
-      header_ptr->next->prev = header_ptr;  // ...then set that allocated block's 'prev' pointer to point back to our best-fit block
+    if (header_ptr->next != NO_LINK) {
+      HEADER(header_ptr->next)->prev = LINK(header_ptr);  // ...then set that allocated block's 'prev' pointer to point back to our best-fit block
     }
-    
-    intptr_t new_free_addr = (intptr_t)new_block_ptr + size; // update the new free address pointer
 
-    // if the new block goes beyond our heap, return NULL
-    if (new_free_addr > end_addr) {
+    // the header must be in place before the heap is bumped past it
+    PERSIST_SYNC(header_ptr, sizeof(header_s));
+    free_addr = new_free_addr;
+    PERSIST_BUMP();
 
-      return NULL;
-
-    } else {
-
-      // if our block allocation is within the heap, update free_addr pointer
-      free_addr = new_free_addr;
+  }
 
-    }
+  // count the block as handed out; its size may exceed the request if it came from the free list
+  size_t block_size  = BLOCK_TO_HEADER(new_block_ptr)->size;
+  total_allocations += 1;
+  total_requested   += size;
+  total_allocated   += block_size;
+  live_blocks       += 1;
+  live_bytes        += block_size;
+  HEAP_UNLOCK();
 
-  }
+  HEAPPROF_MALLOC(new_block_ptr, size); // maybe sample it
+  ALLOCTRACE(ALLOCTRACE_MALLOC, new_block_ptr, size, NULL); // and maybe trace it
+  LATENCY_END();
 
   return new_block_ptr; // return the pointer to new memory block
 
@@ -297,6 +915,16 @@ void free (void* ptr) {
   if (ptr == NULL) {
     return;
   }
+  LATENCY_BEGIN(LATENCY_FREE);
+  HEAPPROF_FREE(ptr); // drop its sample, if it has one
+  ALLOCTRACE(ALLOCTRACE_FREE, ptr, 0, NULL);
+
+  // a guarded sample has no header; its slot is just closed
+  if (GUARDPOOL_OWNS(ptr)) {
+    GUARDPOOL_FREE(ptr);
+    LATENCY_END();
+    return;
+  }
 
   header_s* header_ptr = BLOCK_TO_HEADER(ptr); // will hold address of current block's header
 
@@ -305,36 +933,52 @@ void free (void* ptr) {
     ERROR("Double-free: ", (intptr_t)header_ptr);
   }
 
+  // if the block was mapped on its own, just unmap it
+  if ((intptr_t)header_ptr < start_addr || end_addr <= (intptr_t)header_ptr) {
+    map_free(header_ptr);
+    LATENCY_END();
+    return;
+  }
+  HEAP_LOCK();
+
   /****************************************
    * Remove our block from the allocated 
    * block list
    ****************************************/
 
   // if our current block was the first block in our allocated list
-  if (header_ptr->prev == NULL) {
-    alloc_list_head = header_ptr->next;  // ...then make the next allocated block the first element in our allocated block list
+  if (header_ptr->prev == NO_LINK) {
+    alloc_list_head = HEADER(header_ptr->next);  // ...then make the next allocated block the first element in our allocated block list
   } else {
-    header_ptr->prev->next = header_ptr->next; // ...otherwise, the previous allocated block's 'next' pointer will point to our current block's 'next' allocated block address
+    HEADER(header_ptr->prev)->next = header_ptr->next; // ...otherwise, the previous allocated block's 'next' pointer will point to our current block's 'next' allocated block address
   }
 
   // if our current block  not the last block in the allocated block list
-  if (header_ptr->next != NULL) {
-    header_ptr->next->prev = header_ptr->prev; // ...then the next allocated block's 'prev' pointer will point to the previous allocated block
+  if (header_ptr->next != NO_LINK) {
+    HEADER(header_ptr->next)->prev = header_ptr->prev; // ...then the next allocated block's 'prev' pointer will point to the previous allocated block
   }
   
   /****************************************
    * Add our block to the free block list
    ***************************************/
   
-  header_ptr->next = free_list_head; // set our current block's 'next' pointer to point to first element in the free block list
+  header_ptr->next = LINK(free_list_head); // set our current block's 'next' pointer to point to first element in the free block list
   free_list_head   = header_ptr;  // our free block list pointer will now point to our current block
-  header_ptr->prev = NULL; // set our current block's 'prev' point to null, as it will be the first item in the free block list
+  header_ptr->prev = NO_LINK; // set our current block's 'prev' point to null, as it will be the first item in the free block list
 
   //  if there was already a block in the free block list
-  if (header_ptr->next != NULL) {
-    header_ptr->next->prev = header_ptr;  // ...then set that free block's 'prev' pointer to point back to our current block
+  if (header_ptr->next != NO_LINK) {
+    HEADER(header_ptr->next)->prev = LINK(header_ptr);  // ...then set that free block's 'prev' pointer to point back to our current block
   }
   header_ptr->allocated = false; // mark current block as free
+  PERSIST_SYNC(header_ptr, sizeof(header_s));
+
+  // count the block as returned
+  total_frees += 1;
+  live_blocks -= 1;
+  live_bytes  -= header_ptr->size;
+  HEAP_UNLOCK();
+  LATENCY_END();
 
 } // free()
 // ==============================================================================
@@ -343,75 +987,1051 @@ void free (void* ptr) {
 
 // ==============================================================================
 /**
- * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
+ * Deallocate a block whose size is known.  Every block carries its own header,
+ * which `free()` must update anyway, so the size saves nothing here; it is only
+ * checked, if compiled with `DEBUG_ALLOC`.
  *
- * \param nmemb The number of elements in the new block.
- * \param size  The size, in bytes, of each of the `nmemb` elements.
- * \return      A pointer to the newly allocated and zeroed block, if successful;
- *              `NULL` if unsuccessful.
+ * \param ptr  The block to deallocate; may be `NULL`.
+ * \param size The size originally requested for the block.
  */
-void* calloc (size_t nmemb, size_t size) {
-
-  // Allocate a block of the requested size.
-  size_t block_size    = nmemb * size;
-  void*  new_block_ptr = malloc(block_size);
+void free_sized (void* ptr, size_t size) {
 
-  // If the allocation succeeded, clear the entire block.
-  if (new_block_ptr != NULL) {
-    memset(new_block_ptr, 0, block_size);
+  (void)size;  // each block records its own size; the given one is only checked
+#if defined (DEBUG_ALLOC)
+  // the block may be larger than requested, but never smaller
+  if (ptr != NULL && !GUARDPOOL_OWNS(ptr) && BLOCK_TO_HEADER(ptr)->size < size) {
+    ERROR("free_sized(): Size does not match block", (intptr_t)ptr, size);
   }
+#endif
 
-  return new_block_ptr;
-  
-} // calloc ()
+  free(ptr);
+
+} // free_sized ()
 // ==============================================================================
 
 
 
 // ==============================================================================
 /**
- * Update the given block at `ptr` to take on the given `size`.  Here, if `size`
- * fits within the given block, then the block is returned unchanged.  If the
- * `size` is an increase for the block, then a new and larger block is
- * allocated, and the data from the old block is copied, the old block freed,
- * and the new block returned.
+ * Deallocate a block whose alignment and size are known.  Blocks are never
+ * over-aligned, so this is the same as `free_sized()`.
  *
- * \param ptr  The block to be assigned a new size.
- * \param size The new size that the block should assume.
- * \return     A pointer to the resultant block, which may be `ptr` itself, or
- *             may be a newly allocated block.
+ * \param ptr       The block to deallocate; may be `NULL`.
+ * \param alignment The alignment originally requested for the block.
+ * \param size      The size originally requested for the block.
  */
-void* realloc (void* ptr, size_t size) {
+void free_aligned_sized (void* ptr, size_t alignment, size_t size) {
 
-  // Special case: If there is no original block, then just allocate the new one
-  // of the given size.
-  if (ptr == NULL) {
-    return malloc(size);
-  }
+  assert(alignment <= BLOCK_ALIGNMENT);
+  free_sized(ptr, size);
 
-  // Special case: If the new size is 0, that's tantamount to freeing the block.
-  if (size == 0) {
-    free(ptr);
-    return NULL;
-  }
+} // free_aligned_sized ()
+// ==============================================================================
 
-  // Get the current block size from its header.
-  header_s* header_ptr = BLOCK_TO_HEADER(ptr);
 
-  // If the new size isn't an increase, then just return the original block as-is.
-  if (size <= header_ptr->size) {
-    return ptr;
-  }
 
-  // The new size is an increase.  Allocate the new, larger block, copy the
-  // contents of the old into it, and free the old.
-  void* new_block_ptr = malloc(size);
-  if (new_block_ptr != NULL) {
-    memcpy(new_block_ptr, ptr, header_ptr->size);
-    free(ptr);
+// ==============================================================================
+/**
+ * Allocate `n` blocks of `size` bytes each.  Rather than searching the free
+ * list `n` times, search it once for a single best-fit block that can be split
+ * into all `n` blocks; failing that, bump the heap once for all of them.
+ *
+ * \param size The number of bytes in each block.
+ * \param n    The number of blocks to allocate.
+ * \param ptrs Where to store pointers to the new blocks.
+ * \return     The number of blocks allocated.
+ */
+size_t malloc_batch (size_t size, size_t n, void** ptrs) {
+
+  init();
+
+  // return 0 if size or count requested is 0, or if the batch is too large to
+  // measure without overflowing
+  if (size == 0 || n == 0) {
+    return 0;
   }
-    
-  return new_block_ptr;
-  
-} // realloc()
+  if (size > SIZE_MAX - sizeof(header_s) - (BLOCK_ALIGNMENT - 1)) {
+    return 0;
+  }
+  size_t stride = sizeof(header_s) + ROUND_TO_ALIGNMENT(size); // distance from one piece's header to the next
+  if (n - 1 > (SIZE_MAX - size) / stride) {
+    return 0;
+  }
+  size_t need   = (n - 1) * stride + size;  // usable bytes needed to hold all n pieces after the first header
+
+  /****************************************
+   * A loop to find a best-fit memory block
+   * for the whole batch
+   ***************************************/
+
+  HEAP_LOCK();
+  header_s* current = free_list_head;
+  header_s* best    = NULL;
+  while (current != NULL) {
+
+    if (current->allocated) {
+      ERROR("Allocated block on free list", (intptr_t)current);
+    }
+    if (need <= current->size && (best == NULL || current->size < best->size)) {
+      best = current;
+    }
+    if (best != NULL && best->size == need) {
+      break;
+    }
+    current = HEADER(current->next);
+
+  }
+
+  header_s* first = NULL;  // header of the first piece
+  if (best != NULL) {
+
+    /****************************************
+     * Remove our best-fit block from the
+     * free block list, and split it into n
+     * pieces; the last piece keeps whatever
+     * is left over
+     ***************************************/
+
+    if (best->prev == NO_LINK) {
+      free_list_head   = HEADER(best->next);
+    } else {
+      HEADER(best->prev)->next = best->next;
+    }
+    if (best->next != NO_LINK) {
+      HEADER(best->next)->prev = best->prev;
+    }
+
+    // the block keeps its whole size until the pieces after its first are in
+    // place, so that a walk of the heap never meets a half-split block
+    size_t total = best->size;
+    first        = best;
+    for (size_t i = n - 1; i > 0; i -= 1) {
+      header_s* piece  = (header_s*)((intptr_t)first + i * stride);
+      piece->size      = (i < n - 1) ? stride - sizeof(header_s) : total - (n - 1) * stride;
+      piece->allocated = true;
+    }
+    PERSIST_SYNC((void*)((intptr_t)first + stride), (n - 1) * stride);
+    first->size      = (n > 1) ? stride - sizeof(header_s) : total;
+    first->allocated = true;
+    PERSIST_SYNC(first, sizeof(header_s));
+
+  } else {
+
+    /****************************************
+     * Otherwise, carve all n pieces from the
+     * heap with a single bump, padding only
+     * once
+     ***************************************/
+
+    int padding = 0;
+    if((sizeof(header_s) + free_addr) % BLOCK_ALIGNMENT !=0) {
+      padding = BLOCK_ALIGNMENT - ((sizeof(header_s) + free_addr) % BLOCK_ALIGNMENT);
+    }
+    intptr_t new_free_addr = (intptr_t)((uintptr_t)free_addr + padding + sizeof(header_s) + need);
+
+    // if the batch goes beyond our heap (or wraps around the address space),
+    // allocate what we can one at a time
+    if (new_free_addr < free_addr || new_free_addr > end_addr) {
+      HEAP_UNLOCK();
+      size_t filled = 0;
+      while (filled < n && (ptrs[filled] = malloc(size)) != NULL) {
+	filled += 1;
+      }
+      return filled;
+    }
+
+    first = (header_s*)(free_addr + padding);
+    for (size_t i = 0; i < n; i += 1) {
+      header_s* piece  = (header_s*)((intptr_t)first + i * stride);
+      piece->size      = size;
+      piece->allocated = true;
+    }
+    PERSIST_SYNC(first, new_free_addr - (intptr_t)first);
+    free_addr = new_free_addr;
+    PERSIST_BUMP();
+
+  }
+
+  /****************************************
+   * Chain the pieces together and splice
+   * the whole chain onto the front of the
+   * allocated block list at once
+   ***************************************/
+
+  header_s* last = (header_s*)((intptr_t)first + (n - 1) * stride);
+  for (size_t i = 0; i < n; i += 1) {
+    header_s* piece  = (header_s*)((intptr_t)first + i * stride);
+    piece->prev      = (i == 0)     ? NO_LINK : LINK((header_s*)((intptr_t)piece - stride));
+    piece->next      = (i == n - 1) ? NO_LINK : LINK((header_s*)((intptr_t)piece + stride));
+    ptrs[i]          = HEADER_TO_BLOCK(piece);
+    total_allocated += piece->size;
+    live_bytes      += piece->size;
+  }
+  total_allocations += n;
+  total_requested   += n * size;
+  live_blocks       += n;
+
+#if defined (HEAP_PROFILE) || defined (ALLOC_TRACE)
+  for (size_t i = 0; i < n; i += 1) {
+    HEAPPROF_MALLOC(ptrs[i], size);
+    ALLOCTRACE(ALLOCTRACE_MALLOC, ptrs[i], size, NULL);
+  }
+#endif
+  last->next = LINK(alloc_list_head);
+  if (alloc_list_head != NULL) {
+    alloc_list_head->prev = LINK(last);
+  }
+  alloc_list_head = first;
+  HEAP_UNLOCK();
+
+  return n;
+
+} // malloc_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate `n` blocks at once.  Each block is removed from the allocated
+ * list, and then all of them are spliced onto the free list together.
+ *
+ * \param ptrs The blocks to deallocate; `NULL` entries are skipped.
+ * \param n    The number of entries in `ptrs`.
+ */
+void free_batch (void** ptrs, size_t n) {
+
+  header_s* chain_head = NULL;  // the chain of newly freed blocks
+  header_s* chain_tail = NULL;
+  HEAP_LOCK();
+
+  for (size_t i = 0; i < n; i += 1) {
+
+    if (ptrs[i] == NULL) {
+      continue;
+    }
+    header_s* header_ptr = BLOCK_TO_HEADER(ptrs[i]);
+    if (GUARDPOOL_OWNS(ptrs[i]) ||
+	(intptr_t)header_ptr < start_addr || end_addr <= (intptr_t)header_ptr) {
+      free(ptrs[i]); // guarded or mapped on its own, so on no list
+      continue;
+    }
+    if (!header_ptr->allocated) {
+      ERROR("Double-free: ", (intptr_t)header_ptr);
+    }
+
+    // remove the block from the allocated block list
+    if (header_ptr->prev == NO_LINK) {
+      alloc_list_head = HEADER(header_ptr->next);
+    } else {
+      HEADER(header_ptr->prev)->next = header_ptr->next;
+    }
+    if (header_ptr->next != NO_LINK) {
+      HEADER(header_ptr->next)->prev = header_ptr->prev;
+    }
+
+    // count it as returned, dropping its sample, if it has one
+    HEAPPROF_FREE(ptrs[i]);
+    ALLOCTRACE(ALLOCTRACE_FREE, ptrs[i], 0, NULL);
+    total_frees += 1;
+    live_blocks -= 1;
+    live_bytes  -= header_ptr->size;
+
+    // add it to the front of the chain
+    header_ptr->allocated = false;
+    PERSIST_SYNC(header_ptr, sizeof(header_s));
+    header_ptr->prev      = NO_LINK;
+    header_ptr->next      = LINK(chain_head);
+    if (chain_head != NULL) {
+      chain_head->prev = LINK(header_ptr);
+    } else {
+      chain_tail = header_ptr;
+    }
+    chain_head = header_ptr;
+
+  }
+
+  // splice the chain onto the front of the free block list
+  if (chain_head != NULL) {
+    chain_tail->next = LINK(free_list_head);
+    if (free_list_head != NULL) {
+      free_list_head->prev = LINK(chain_tail);
+    }
+    free_list_head = chain_head;
+  }
+  HEAP_UNLOCK();
+
+} // free_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
+ *
+ * \param nmemb The number of elements in the new block.
+ * \param size  The size, in bytes, of each of the `nmemb` elements.
+ * \return      A pointer to the newly allocated and zeroed block, if successful;
+ *              `NULL` if unsuccessful.
+ */
+void* calloc (size_t nmemb, size_t size) {
+
+  // Allocate a block of the requested size.
+  size_t block_size    = nmemb * size;
+  ALLOCTRACE_NEST();
+  void*  new_block_ptr = malloc(block_size);
+  ALLOCTRACE_UNNEST();
+
+  // If the allocation succeeded, clear the entire block.
+  if (new_block_ptr != NULL) {
+    memset(new_block_ptr, 0, block_size);
+    ALLOCTRACE(ALLOCTRACE_CALLOC, new_block_ptr, block_size, NULL);
+  }
+
+  return new_block_ptr;
+  
+} // calloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Update the given block at `ptr` to take on the given `size`.  Here, if `size`
+ * fits within the given block, then the block is returned unchanged.  If the
+ * `size` is an increase for the block, then a new and larger block is
+ * allocated, and the data from the old block is copied, the old block freed,
+ * and the new block returned.
+ *
+ * \param ptr  The block to be assigned a new size.
+ * \param size The new size that the block should assume.
+ * \return     A pointer to the resultant block, which may be `ptr` itself, or
+ *             may be a newly allocated block.
+ */
+void* realloc (void* ptr, size_t size) {
+
+  // Special case: If there is no original block, then just allocate the new one
+  // of the given size.
+  if (ptr == NULL) {
+    return malloc(size);
+  }
+
+  // Special case: If the new size is 0, that's tantamount to freeing the block.
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  // Get the current block size from its header (or, if guarded, its slot).
+  size_t old_size = GUARDPOOL_OWNS(ptr) ? GUARDPOOL_SIZE(ptr) : BLOCK_TO_HEADER(ptr)->size;
+
+  // If the new size isn't an increase, then just return the original block as-is.
+  if (size <= old_size) {
+    ALLOCTRACE(ALLOCTRACE_REALLOC, ptr, size, ptr);
+    return ptr;
+  }
+
+  // The new size is an increase.  Allocate the new, larger block, copy the
+  // contents of the old into it, and free the old.
+  ALLOCTRACE_NEST(); // trace this as one realloc, not a malloc and a free
+  void* new_block_ptr = malloc(size);
+  if (new_block_ptr != NULL) {
+    memcpy(new_block_ptr, ptr, old_size);
+    free(ptr);
+  }
+  ALLOCTRACE_UNNEST();
+  if (new_block_ptr != NULL) {
+    ALLOCTRACE(ALLOCTRACE_REALLOC, new_block_ptr, size, ptr);
+  }
+    
+  return new_block_ptr;
+  
+} // realloc()
+// ==============================================================================
+
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the allocator's global statistics.  The free list is
+ * walked to count its blocks; since the heap is laid out contiguously, whatever
+ * is neither a live nor a free block is header or padding.
+ *
+ * \param stats Where to store the snapshot.
+ */
+void malloc_get_stats (alloc_stats_s* stats) {
+
+  init();
+  memset(stats, 0, sizeof(alloc_stats_s));
+  HEAP_LOCK();
+
+  // walk the free list
+  for (header_s* current = free_list_head; current != NULL; current = HEADER(current->next)) {
+    stats->free_blocks += 1;
+    stats->free_bytes  += current->size;
+  }
+
+  stats->allocations     = total_allocations;
+  stats->frees           = total_frees;
+  stats->requested_bytes = total_requested;
+  stats->allocated_bytes = total_allocated;
+  stats->live_blocks     = live_blocks;
+  stats->live_bytes      = live_bytes;
+  stats->heap_bytes      = free_addr - start_addr;
+  stats->overhead_bytes  = stats->heap_bytes - stats->live_bytes - stats->free_bytes;
+  stats->large_mappings  = large_mappings;
+  stats->large_bytes     = large_bytes;
+  HEAP_UNLOCK();
+
+} // malloc_get_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the statistics of each size class.  This allocator has no
+ * size classes.
+ *
+ * \param classes Unused.
+ * \param n       Unused.
+ * \return        0, the number of size classes.
+ */
+size_t malloc_get_class_stats (alloc_class_stats_s* classes, size_t n) {
+
+  (void)classes;
+  (void)n;
+  return 0;
+
+} // malloc_get_class_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Fill in the standard `mallinfo2` summary from the allocator's statistics.
+ *
+ * \return The summary.
+ */
+struct mallinfo2 mallinfo2 () {
+
+  alloc_stats_s stats;
+  malloc_get_stats(&stats);
+
+  struct mallinfo2 info;
+  memset(&info, 0, sizeof(info));
+  info.arena    = stats.heap_bytes;
+  info.ordblks  = stats.free_blocks;
+  info.uordblks = stats.live_bytes;
+  info.fordblks = stats.free_bytes;
+  info.hblks    = stats.large_mappings;
+  info.hblkhd   = stats.large_bytes;
+  return info;
+
+} // mallinfo2 ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write one named statistic, on a line of its own, to `stderr`.
+ *
+ * \param name  The name of the statistic.
+ * \param value Its value.
+ */
+static void stats_line (const char* name, size_t value) {
+
+  safe_write(STDERR_FILENO, name);
+  safe_write(STDERR_FILENO, "\t");
+  safe_write_dec(STDERR_FILENO, value);
+  safe_write(STDERR_FILENO, "\n");
+
+} // stats_line ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's global statistics to `stderr`.  Nothing is allocated.
+ */
+void malloc_stats () {
+
+  alloc_stats_s stats;
+  malloc_get_stats(&stats);
+
+  safe_write(STDERR_FILENO, "bf-alloc statistics\n");
+  stats_line("allocations",     stats.allocations);
+  stats_line("frees",           stats.frees);
+  stats_line("requested_bytes", stats.requested_bytes);
+  stats_line("allocated_bytes", stats.allocated_bytes);
+  stats_line("live_blocks",     stats.live_blocks);
+  stats_line("live_bytes",      stats.live_bytes);
+  stats_line("free_blocks",     stats.free_blocks);
+  stats_line("free_bytes",      stats.free_bytes);
+  stats_line("overhead_bytes",  stats.overhead_bytes);
+  stats_line("heap_bytes",      stats.heap_bytes);
+  stats_line("large_mappings",  stats.large_mappings);
+  stats_line("large_bytes",     stats.large_bytes);
+
+} // malloc_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics at exit, if configured to.
+ */
+static void __attribute__((destructor)) stats_at_exit () {
+
+  if (conf.stats) {
+    malloc_stats();
+  }
+
+} // stats_at_exit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count one block toward a fragmentation report.
+ *
+ * \param header  The block's header.
+ * \param padding The padding after the block.
+ * \param context The report.
+ */
+static void frag_visit (header_s* header, size_t padding, void* context) {
+
+  alloc_frag_s* frag = context;
+  frag->header_bytes  += sizeof(header_s);
+  frag->padding_bytes += padding;
+
+  if (header->allocated) {
+    frag->live_blocks += 1;
+    frag->live_bytes  += header->size;
+    return;
+  }
+
+  // file it in the histogram by the log of its size
+  size_t bucket = (header->size == 0) ? 0 : 8 * sizeof(size_t) - 1 - __builtin_clzll(header->size);
+  if (bucket >= FRAG_BUCKETS) {
+    bucket = FRAG_BUCKETS - 1;
+  }
+  frag->free_blocks              += 1;
+  frag->free_bytes               += header->size;
+  frag->histogram_blocks[bucket] += 1;
+  frag->histogram_bytes[bucket]  += header->size;
+  if (header->size > frag->largest_free) {
+    frag->largest_free = header->size;
+  }
+
+} // frag_visit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Walk every block of the heap, free and allocated, and report how fragmented
+ * it is.
+ *
+ * \param frag Where to store the report.
+ */
+void malloc_get_fragmentation (alloc_frag_s* frag) {
+
+  init();
+  memset(frag, 0, sizeof(alloc_frag_s));
+  HEAP_LOCK();
+  walk_heap(frag_visit, frag);
+
+  frag->heap_bytes   = free_addr - start_addr;
+  frag->unused_bytes = end_addr - free_addr;
+  HEAP_UNLOCK();
+  if (frag->free_bytes != 0) {
+    frag->fragmentation_permille = 1000 - (frag->largest_free * 1000) / frag->free_bytes;
+  }
+
+} // malloc_get_fragmentation ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Spread one block's bytes over the cells of the fragmentation map that it
+ * overlaps.
+ *
+ * \param header  The block's header.
+ * \param padding The padding after the block (not counted).
+ * \param context The map.
+ */
+static void map_visit (header_s* header, size_t padding, void* context) {
+
+  (void)padding;
+  frag_map_s* map    = context;
+  size_t*     counts = header->allocated ? map->live : map->free;
+  size_t      first  = (intptr_t)HEADER_TO_BLOCK(header) - start_addr;
+  size_t      last   = first + header->size;
+  while (first < last) {
+    size_t cell     = first / map->cell_size;
+    size_t cell_end = (cell + 1) * map->cell_size;
+    size_t end      = (last < cell_end) ? last : cell_end;
+    counts[cell]   += end - first;
+    first           = end;
+  }
+
+} // map_visit ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write one named statistic, on a line of its own, to a file descriptor.
+ *
+ * \param fd    The file descriptor.
+ * \param name  The name of the statistic.
+ * \param value Its value.
+ */
+static void report_line (int fd, const char* name, size_t value) {
+
+  safe_write(fd, name);
+  safe_write(fd, "\t");
+  safe_write_dec(fd, value);
+  safe_write(fd, "\n");
+
+} // report_line ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write a fragmentation report to a file descriptor, followed by the non-empty
+ * buckets of its histogram and a coarse map of the used heap.
+ *
+ * \param fd The file descriptor.
+ */
+void malloc_fragmentation_dump (int fd) {
+
+  static alloc_frag_s frag;  // too big for the stack of an arbitrary caller
+  static frag_map_s   map;
+  init();
+  HEAP_LOCK();  // the map must cover the heap as reported
+  malloc_get_fragmentation(&frag);
+
+  safe_write(fd, "bf-alloc fragmentation\n");
+  report_line(fd, "free_blocks",            frag.free_blocks);
+  report_line(fd, "free_bytes",             frag.free_bytes);
+  report_line(fd, "largest_free",           frag.largest_free);
+  report_line(fd, "fragmentation_permille", frag.fragmentation_permille);
+  report_line(fd, "live_blocks",            frag.live_blocks);
+  report_line(fd, "live_bytes",             frag.live_bytes);
+  report_line(fd, "header_bytes",           frag.header_bytes);
+  report_line(fd, "padding_bytes",          frag.padding_bytes);
+  report_line(fd, "heap_bytes",             frag.heap_bytes);
+  report_line(fd, "unused_bytes",           frag.unused_bytes);
+
+  safe_write(fd, "min_size\tfree_blocks\tfree_bytes\n");
+  for (size_t bucket = 0; bucket < FRAG_BUCKETS; bucket += 1) {
+    if (frag.histogram_blocks[bucket] != 0) {
+      safe_write_dec(fd, (size_t)1 << bucket);
+      safe_write(fd, "\t");
+      safe_write_dec(fd, frag.histogram_blocks[bucket]);
+      safe_write(fd, "\t");
+      safe_write_dec(fd, frag.histogram_bytes[bucket]);
+      safe_write(fd, "\n");
+    }
+  }
+
+  if (frag.heap_bytes == 0) {
+    HEAP_UNLOCK();
+    return;
+  }
+
+  // map the used heap, cell by cell
+  memset(&map, 0, sizeof(map));
+  map.cell_size = (frag.heap_bytes + FRAG_MAP_CELLS - 1) / FRAG_MAP_CELLS;
+  if (map.cell_size < BLOCK_ALIGNMENT) {
+    map.cell_size = BLOCK_ALIGNMENT;
+  }
+  walk_heap(map_visit, &map);
+  HEAP_UNLOCK();
+
+  size_t cells = (frag.heap_bytes + map.cell_size - 1) / map.cell_size;
+  report_line(fd, "map_cell_bytes", map.cell_size);
+  char line[FRAG_MAP_COLUMNS + 2];
+  for (size_t row = 0; row * FRAG_MAP_COLUMNS < cells; row += 1) {
+    size_t column = 0;
+    for (; column < FRAG_MAP_COLUMNS && row * FRAG_MAP_COLUMNS + column < cells; column += 1) {
+      size_t cell = row * FRAG_MAP_COLUMNS + column;
+      size_t used = map.live[cell] + map.free[cell];
+      if (used == 0) {
+	line[column] = ' ';
+      } else if (map.live[cell] * 10 >= used * 9) {
+	line[column] = '#';
+      } else if (map.free[cell] * 10 >= used * 9) {
+	line[column] = '.';
+      } else {
+	line[column] = '+';
+      }
+    }
+    line[column]     = '\n';
+    line[column + 1] = '\0';
+    safe_write(fd, line);
+  }
+
+} // malloc_fragmentation_dump ()
+// ==============================================================================
+
+
+// ==============================================================================
+/**
+ * Find the offset of a block from the start of the heap.
+ *
+ * \param ptr The block; may be `NULL`.
+ * \return    Its offset, or 0 if `ptr` is `NULL`.
+ */
+size_t malloc_offset (const void* ptr) {
+
+  init();
+  if (ptr == NULL) {
+    return 0;
+  }
+  if ((intptr_t)ptr <= start_addr || end_addr <= (intptr_t)ptr) {
+    ERROR("malloc_offset(): Block is not in the heap", (intptr_t)ptr);
+  }
+  return (intptr_t)ptr - start_addr;
+
+} // malloc_offset ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find a block from its offset from the start of the heap.
+ *
+ * \param offset The offset, as returned by `malloc_offset()`.
+ * \return       The block, or `NULL` if `offset` is 0.
+ */
+void* malloc_at_offset (size_t offset) {
+
+  init();
+  if (offset == 0) {
+    return NULL;
+  }
+  if (offset >= (size_t)(end_addr - start_addr)) {
+    ERROR("malloc_at_offset(): Offset is beyond the heap", offset);
+  }
+  return (void*)(start_addr + offset);
+
+} // malloc_at_offset ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record the application's root block, from which it can find its data again
+ * when the heap is reopened.
+ *
+ * \param ptr The root block; may be `NULL`.
+ */
+void malloc_set_root (void* ptr) {
+
+  init();
+#if defined (PERSISTENT_HEAP)
+  size_t offset = malloc_offset(ptr);
+  HEAP_LOCK();
+  superblock->root = offset;
+  PERSIST_SYNC(&superblock->root, sizeof(superblock->root));
+  HEAP_UNLOCK();
+#else
+  root = ptr;
+#endif
+
+} // malloc_set_root ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the application's root block.
+ *
+ * \return The root block, or `NULL` if none has been recorded.
+ */
+void* malloc_get_root () {
+
+  init();
+#if defined (PERSISTENT_HEAP)
+  return malloc_at_offset(superblock->root);
+#else
+  return root;
+#endif
+
+} // malloc_get_root ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Flush the whole used heap to its file, if it is kept in one, so that the
+ * application's own data survives a crash of the machine.
+ */
+void malloc_sync () {
+
+  init();
+#if defined (PERSISTENT_HEAP)
+  if (conf.persist_path[0] != '\0') {
+    heapfile_sync((void*)start_addr, free_addr - start_addr);
+  }
+#endif
+
+} // malloc_sync ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the descriptor of a shared heap in a memfd.
+ *
+ * \return The descriptor, or -1 if the heap is not in a memfd.
+ */
+int malloc_shared_fd () {
+
+  init();
+#if defined (PERSISTENT_HEAP)
+  return shared_fd;
+#else
+  return -1;
+#endif
+
+} // malloc_shared_fd ()
+// ==============================================================================
+
+
+
+#if defined (PERSISTENT_HEAP)
+// ==============================================================================
+/**
+ * Close a heap kept in a file at exit, saving its lists in the superblock so
+ * that they need not be rebuilt when it is reopened.  This runs after any
+ * destructor without a priority, which may still free blocks.
+ */
+static void __attribute__((destructor(101))) close_at_exit () {
+
+  if (superblock == NULL || conf.persist_path[0] == '\0') {
+    return;
+  }
+  superblock->used            = free_addr - start_addr;
+  superblock->free_list_head  = LINK(free_list_head);
+  superblock->alloc_list_head = LINK(alloc_list_head);
+  superblock->live_blocks     = live_blocks;
+  superblock->live_bytes      = live_bytes;
+
+  // the lists must be on the disk before the superblock says that they are
+  heapfile_sync((void*)start_addr, free_addr - start_addr);
+  superblock->clean = true;
+  heapfile_sync(superblock, sizeof(superblock_s));
+
+} // close_at_exit ()
+// ==============================================================================
+#endif /* PERSISTENT_HEAP */
+
+
+
+// ==============================================================================
+/**
+ * Allocate a new chunk for an arena from the heap, large enough for at least
+ * `size` bytes after its header, and make it the arena's current chunk.
+ *
+ * \param arena The arena.
+ * \param size  The number of bytes needed in the chunk.
+ * \return      `true` if successful; `false` if the heap is exhausted.
+ */
+static bool arena_grow (arena_s* arena, size_t size) {
+
+  // a chunk too large to measure cannot be had
+  if (size > PTRDIFF_MAX - ARENA_CHUNK_HEADER) {
+    return false;
+  }
+
+  size_t chunk_size = arena->chunk_size;
+  if (chunk_size < ARENA_CHUNK_HEADER + size) {
+    chunk_size = ARENA_CHUNK_HEADER + size;  // an oversized request gets a chunk to itself
+  }
+
+  arena_chunk_s* chunk = malloc(chunk_size);
+  if (chunk == NULL) {
+    return false;
+  }
+  chunk->prev    = arena->current;
+  chunk->limit   = (intptr_t)chunk + chunk_size;
+  arena->current = chunk;
+  arena->cursor  = (intptr_t)chunk + ARENA_CHUNK_HEADER;
+  arena->limit   = chunk->limit;
+  return true;
+
+} // arena_grow ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Create an arena, placing it at the start of its own first chunk.
+ *
+ * \param chunk_size The size of each chunk, or 0 for `ARENA_CHUNK_SIZE`.
+ * \return           The new arena, or `NULL` if the heap is exhausted.
+ */
+arena_s* arena_create (size_t chunk_size) {
+
+  if (chunk_size == 0) {
+    chunk_size = ARENA_CHUNK_SIZE;
+  }
+  if (chunk_size < ARENA_HEADER) {
+    chunk_size = ARENA_HEADER;
+  }
+
+  arena_chunk_s* chunk = malloc(chunk_size);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->prev  = NULL;
+  chunk->limit = (intptr_t)chunk + chunk_size;
+
+  arena_s* arena    = (arena_s*)((intptr_t)chunk + ARENA_CHUNK_HEADER);
+  arena->current    = chunk;
+  arena->cursor     = (intptr_t)chunk + ARENA_HEADER;
+  arena->limit      = chunk->limit;
+  arena->chunk_size = chunk_size;
+  return arena;
+
+} // arena_create ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block from an arena by bumping its cursor, moving to a new chunk
+ * only if the current one is exhausted.
+ *
+ * \param arena The arena.
+ * \param size  The number of bytes to allocate.
+ * \return      A pointer to the block, or `NULL` if `size` is 0 or the heap is
+ *               exhausted.
+ */
+void* arena_alloc (arena_s* arena, size_t size) {
+
+  // return NULL if size requested is 0, or too large to round up and compare
+  // with the room left
+  if (size == 0 || size > SIZE_MAX - (BLOCK_ALIGNMENT - 1)) {
+    return NULL;
+  }
+
+  size = ROUND_TO_ALIGNMENT(size);  // keep the cursor aligned for the next block
+  if (size > PTRDIFF_MAX) {
+    return NULL;
+  }
+  if (arena->limit - arena->cursor < (intptr_t)size) {
+    if (!arena_grow(arena, size)) {
+      return NULL;
+    }
+  }
+
+  void* block_ptr = (void*)arena->cursor;
+  arena->cursor  += size;
+  return block_ptr;
+
+} // arena_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record the current point in an arena's allocations.
+ *
+ * \param arena The arena.
+ * \return      The mark.
+ */
+arena_mark_s arena_mark (arena_s* arena) {
+
+  arena_mark_s mark = { arena->current, arena->cursor };
+  return mark;
+
+} // arena_mark ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Roll an arena back to a mark, returning every chunk added since then to the
+ * heap.
+ *
+ * \param arena The arena.
+ * \param mark  A mark previously returned by `arena_mark()` for this arena.
+ */
+void arena_release_to_mark (arena_s* arena, arena_mark_s mark) {
+
+  // free the chunks that are newer than the mark's chunk
+  while (arena->current != mark.chunk) {
+    arena_chunk_s* chunk = arena->current;
+    if (chunk == NULL) {
+      ERROR("arena_release_to_mark(): Mark is not in this arena", (intptr_t)arena);
+    }
+    arena->current = chunk->prev;
+    free(chunk);
+  }
+
+  arena->cursor = mark.cursor;
+  arena->limit  = arena->current->limit;
+
+} // arena_release_to_mark ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free every block allocated from an arena, keeping only its first chunk
+ * (which holds the arena itself).
+ *
+ * \param arena The arena.
+ */
+void arena_reset (arena_s* arena) {
+
+  arena_mark_s start = { (arena_chunk_s*)((intptr_t)arena - ARENA_CHUNK_HEADER),
+			 (intptr_t)arena - ARENA_CHUNK_HEADER + ARENA_HEADER };
+  arena_release_to_mark(arena, start);
+
+} // arena_reset ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free an arena and all of its chunks.
+ *
+ * \param arena The arena.
+ */
+void arena_destroy (arena_s* arena) {
+
+  arena_reset(arena);
+  free(arena->current);
+
+} // arena_destroy ()
 // ==============================================================================
@@ -0,0 +1,386 @@
+// ==============================================================================
+/**
+ * guardpool.c
+ *
+ * The guard-page pool.  The pool is a single mapping of `2 * GUARDPOOL_SLOTS +
+ * 1` pages, all inaccessible except the slot pages of live sampled blocks:
+ *
+ *   | guard | slot 0 | guard | slot 1 | guard | ... | slot N-1 | guard |
+ *
+ * A fault anywhere in the pool is caught by a `SIGSEGV` handler, which works
+ * out from the faulting address which block was overrun or used after being
+ * freed, reports it, and lets the fault kill the process.  Faults elsewhere
+ * are passed on to whatever handler was installed before.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "guardpool.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** The states of a slot. */
+typedef enum slot_state {
+
+  SLOT_UNUSED = 0,
+  SLOT_LIVE,
+  SLOT_FREED
+
+} slot_state_e;
+
+/** What is known of a slot's block. */
+typedef struct slot {
+
+  slot_state_e state;
+  uintptr_t    block;
+  size_t       size;
+  void*        allocated_by;
+  void*        freed_by;
+
+} slot_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The alignment of every sampled block, as of every other block. */
+#define GUARDPOOL_ALIGNMENT 16
+
+/** The address of the page of a slot. */
+#define SLOT_PAGE(index) (guardpool_start + (2 * (index) + 1) * page_size)
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+intptr_t  guardpool_countdown = GUARDPOOL_DEFAULT_RATE;
+uintptr_t guardpool_start     = 0;
+size_t    guardpool_length    = 0;
+
+/** The mean distance between samples. */
+static size_t rate = GUARDPOOL_DEFAULT_RATE;
+
+/** The page size, cached when the pool is created. */
+static size_t page_size = 0;
+
+/** The slots, and where to start looking for the next one to use. */
+static slot_s       slots[GUARDPOOL_SLOTS];
+static unsigned int next_slot = 0;
+
+/** The state of the random number generator. */
+static uint64_t random_state = 0x9e3779b97f4a7c15ull;
+
+/** The `SIGSEGV` handler in place before the pool's. */
+static struct sigaction previous_handler;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Generate a pseudo-random number (_xorshift64_). */
+static uint64_t xorshift () {
+
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+
+} // xorshift ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** Choose the distance to the next sample, uniformly between 1 and `2 * rate`. */
+static void reset_countdown () {
+
+  guardpool_countdown = (rate == 0) ? INTPTR_MAX : (intptr_t)(1 + xorshift() % (2 * rate));
+
+} // reset_countdown ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void guardpool_set_rate (size_t new_rate) {
+
+  rate = new_rate;
+  reset_countdown();
+
+} // guardpool_set_rate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write one line of a report: a label, an address, and an optional number.
+ */
+static void report_line (const char* label, uintptr_t address, const char* what, size_t number) {
+
+  safe_write(STDERR_FILENO, "guardpool: ");
+  safe_write(STDERR_FILENO, label);
+  safe_write_hex(STDERR_FILENO, address);
+  if (what != NULL) {
+    safe_write(STDERR_FILENO, what);
+    safe_write_dec(STDERR_FILENO, number);
+  }
+  safe_write(STDERR_FILENO, "\n");
+
+} // report_line ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Report an error involving a sampled block.
+ *
+ * \param error   What went wrong.
+ * \param address The address involved.
+ * \param slot    The block's slot.
+ */
+static void report (const char* error, uintptr_t address, const slot_s* slot) {
+
+  safe_write(STDERR_FILENO, "guardpool: ");
+  safe_write(STDERR_FILENO, error);
+  safe_write(STDERR_FILENO, "\n");
+  report_line("at address ", address, NULL, 0);
+  report_line("block ", slot->block, ", size ", slot->size);
+  report_line("allocated by ", (uintptr_t)slot->allocated_by, NULL, 0);
+  if (slot->state == SLOT_FREED) {
+    report_line("freed by ", (uintptr_t)slot->freed_by, NULL, 0);
+  }
+
+} // report ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Restore the default action for a segmentation fault, so that the next one
+ * kills the process.
+ */
+static void restore_default () {
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = SIG_DFL;
+  sigaction(SIGSEGV, &action, NULL);
+
+} // restore_default ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Handle a segmentation fault.  If it is in the pool, report what caused it and
+ * restore the default action, so that returning repeats the fault and kills
+ * the process.  Otherwise, pass it to the previous handler, staying installed
+ * for the faults to come (a runtime may well recover from its own); only if
+ * there was no previous handler is the default action restored and the fault
+ * raised again.
+ */
+static void on_fault (int signal, siginfo_t* info, void* context) {
+
+  uintptr_t address = (uintptr_t)info->si_addr;
+  if (address - guardpool_start >= guardpool_length) {
+    if (previous_handler.sa_flags & SA_SIGINFO) {
+      previous_handler.sa_sigaction(signal, info, context);
+    } else if (previous_handler.sa_handler != SIG_DFL && previous_handler.sa_handler != SIG_IGN) {
+      previous_handler.sa_handler(signal);
+    } else {
+      restore_default();
+      raise(signal);
+    }
+    return;
+  }
+
+  size_t page = (address - guardpool_start) / page_size;
+  if (page % 2 == 1) {
+
+    // A slot page, so its block has been freed (or it was never used).
+    const slot_s* slot = &slots[page / 2];
+    if (slot->state == SLOT_FREED) {
+      report("use-after-free", address, slot);
+    } else {
+      report_line("wild access to an unused slot at ", address, NULL, 0);
+    }
+
+  } else {
+
+    // A guard page, so the nearer of its neighbors' blocks was overrun.
+    const slot_s* left  = (page > 0)                   ? &slots[page / 2 - 1] : NULL;
+    const slot_s* right = (page / 2 < GUARDPOOL_SLOTS) ? &slots[page / 2]     : NULL;
+    if (left != NULL && left->state == SLOT_UNUSED) {
+      left = NULL;
+    }
+    if (right != NULL && right->state == SLOT_UNUSED) {
+      right = NULL;
+    }
+    if (left != NULL && right != NULL) {
+      if (address - (left->block + left->size) < right->block - address) {
+	right = NULL;
+      } else {
+	left = NULL;
+      }
+    }
+
+    if (left != NULL) {
+      report(left->state == SLOT_FREED ? "use-after-free, out of bounds" : "buffer overflow", address, left);
+    } else if (right != NULL) {
+      report(right->state == SLOT_FREED ? "use-after-free, out of bounds" : "buffer underflow", address, right);
+    } else {
+      report_line("wild access to a guard page at ", address, NULL, 0);
+    }
+
+  }
+
+  restore_default();
+
+} // on_fault ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Create the pool, every page of it inaccessible, and install the fault
+ * handler.
+ *
+ * \return `true` if successful.
+ */
+static bool create () {
+
+  page_size = sysconf(_SC_PAGESIZE);
+  size_t length = (2 * GUARDPOOL_SLOTS + 1) * page_size;
+  void*  pool   = mmap(NULL,
+		       length,
+		       PROT_NONE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+		       -1,
+		       0);
+  if (pool == MAP_FAILED) {
+    return false;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = on_fault;
+  action.sa_flags     = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGSEGV, &action, &previous_handler) == -1) {
+    munmap(pool, length);
+    return false;
+  }
+
+  guardpool_start  = (uintptr_t)pool;
+  guardpool_length = length;
+  return true;
+
+} // create ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* guardpool_alloc (size_t size, void* caller) {
+
+  reset_countdown();
+  if (guardpool_start == 0 && !create()) {
+    guardpool_set_rate(0);
+    return NULL;
+  }
+  if (size == 0 || size > page_size) {
+    return NULL;
+  }
+
+  // Take the next slot not in use, so that freed slots stay inaccessible for
+  // as long as possible.
+  unsigned int index = next_slot;
+  for (unsigned int tried = 0; slots[index].state == SLOT_LIVE; tried += 1) {
+    if (tried == GUARDPOOL_SLOTS) {
+      return NULL;
+    }
+    index = (index + 1) % GUARDPOOL_SLOTS;
+  }
+  next_slot = (index + 1) % GUARDPOOL_SLOTS;
+
+  uintptr_t page = SLOT_PAGE(index);
+  if (mprotect((void*)page, page_size, PROT_READ | PROT_WRITE) == -1) {
+    return NULL;
+  }
+
+  // Place the block against one end of the page or the other, at random, to
+  // catch overflows or underflows.
+  uintptr_t block = page;
+  if (xorshift() & 1) {
+    block = (page + page_size - size) & ~(uintptr_t)(GUARDPOOL_ALIGNMENT - 1);
+  }
+
+  slot_s* slot       = &slots[index];
+  slot->state        = SLOT_LIVE;
+  slot->block        = block;
+  slot->size         = size;
+  slot->allocated_by = caller;
+  slot->freed_by     = NULL;
+  return (void*)block;
+
+} // guardpool_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void guardpool_free (void* ptr, void* caller) {
+
+  size_t  page = ((uintptr_t)ptr - guardpool_start) / page_size;
+  slot_s* slot = &slots[page / 2];
+  if (page % 2 == 0 || slot->state == SLOT_UNUSED || slot->block != (uintptr_t)ptr) {
+    report_line("invalid free of ", (uintptr_t)ptr, NULL, 0);
+    abort();
+  }
+  if (slot->state == SLOT_FREED) {
+    report("double free", (uintptr_t)ptr, slot);
+    report_line("freed again by ", (uintptr_t)caller, NULL, 0);
+    abort();
+  }
+
+  mprotect((void*)SLOT_PAGE(page / 2), page_size, PROT_NONE);
+  slot->state    = SLOT_FREED;
+  slot->freed_by = caller;
+
+} // guardpool_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+size_t guardpool_size (void* ptr) {
+
+  return slots[((uintptr_t)ptr - guardpool_start) / page_size / 2].size;
+
+} // guardpool_size ()
+// ==============================================================================
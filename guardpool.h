@@ -0,0 +1,144 @@
+// ==============================================================================
+/**
+ * guardpool.h
+ *
+ * A sampling guard-page pool for the allocators, for catching heap corruption
+ * in production.  Roughly one allocation in `rate` is diverted to a slot of its
+ * own: a page with an inaccessible guard page on either side, its block placed
+ * against one end of it at random.  When the block is freed, its page is made
+ * inaccessible too, and its slot is reused as late as possible.  An overflow,
+ * an underflow, or a use after free of a sampled block thus faults at once,
+ * and a report of the block (its size and where it was allocated and freed) is
+ * written to `stderr` before the process dies.  Nothing here allocates from
+ * the heap.
+ *
+ * Sampling is compiled into the allocators only if `GUARD_POOL` is defined.
+ * Unsampled allocations then pay only for counting down to the next sample.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_GUARDPOOL_H)
+#define _GUARDPOOL_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The default mean number of allocations between samples. */
+#define GUARDPOOL_DEFAULT_RATE 5000
+
+/** The number of slots, and so the most sampled blocks live at once. */
+#define GUARDPOOL_SLOTS 256
+
+/** Hooks for the allocators (or, if disabled, nothing). */
+#if defined (GUARD_POOL)
+#define GUARDPOOL_MALLOC(size)						\
+  (guardpool_due() ? guardpool_alloc((size), __builtin_return_address(0)) : NULL)
+#define GUARDPOOL_OWNS(ptr) guardpool_owns(ptr)
+#define GUARDPOOL_FREE(ptr) guardpool_free((ptr), __builtin_return_address(0))
+#define GUARDPOOL_SIZE(ptr) guardpool_size(ptr)
+#else
+#define GUARDPOOL_MALLOC(size) NULL
+#define GUARDPOOL_OWNS(ptr) false
+#define GUARDPOOL_FREE(ptr)
+#define GUARDPOOL_SIZE(ptr) 0
+#endif /* GUARD_POOL */
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The number of allocations still to be made before the next sample. */
+extern intptr_t  guardpool_countdown;
+
+/** The address and length of the pool, or 0 and 0 before its first use. */
+extern uintptr_t guardpool_start;
+extern size_t    guardpool_length;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count an allocation against the distance to the next sample.
+ *
+ * \return `true` if the allocation should be sampled.
+ */
+static inline bool guardpool_due () {
+
+  return __builtin_expect(--guardpool_countdown <= 0, 0);
+
+} // guardpool_due ()
+
+/**
+ * Is a block in the pool?
+ *
+ * \param ptr The block.
+ * \return    `true` if it is.
+ */
+static inline bool guardpool_owns (void* ptr) {
+
+  return (uintptr_t)ptr - guardpool_start < guardpool_length;
+
+} // guardpool_owns ()
+
+/**
+ * Set the mean number of allocations between samples.
+ *
+ * \param rate The mean distance, or 0 to stop sampling.
+ */
+void guardpool_set_rate (size_t rate);
+
+/**
+ * Allocate a sampled block in a guarded slot, and choose the distance to the
+ * next sample.
+ *
+ * \param size   The number of bytes requested.
+ * \param caller Where the allocation was made, for reports.
+ * \return       The block, or `NULL` if it is too large for a slot or every
+ *               slot is taken; the caller should then allocate normally.
+ */
+void* guardpool_alloc (size_t size, void* caller);
+
+/**
+ * Free a sampled block, leaving its slot inaccessible.  A double or invalid
+ * free is reported, and is fatal.
+ *
+ * \param ptr    The block.
+ * \param caller Where the block was freed, for reports.
+ */
+void guardpool_free (void* ptr, void* caller);
+
+/**
+ * Find the size of a sampled block.
+ *
+ * \param ptr The block.
+ * \return    The number of bytes requested for it.
+ */
+size_t guardpool_size (void* ptr);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _GUARDPOOL_H
+// ==============================================================================
@@ -0,0 +1,232 @@
+// ==============================================================================
+/**
+ * heapfile.c
+ *
+ * Heaps kept in files, mapped with `mmap()` and locked with `flock()`.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "heapfile.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** The pause, in nanoseconds, between looks at a shared heap not yet formatted... */
+#define SHARED_FORMAT_PAUSE 1000000
+
+/** ...and the most looks taken before giving up. */
+#define SHARED_FORMAT_TRIES 10000
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Report a failure involving a heap file, and die.
+ *
+ * \param path   The file.
+ * \param reason What went wrong.
+ */
+static void fail (const char* path, const char* reason) {
+
+  int error = errno;
+  safe_write(STDERR_FILENO, "heapfile: ");
+  safe_write(STDERR_FILENO, path);
+  safe_write(STDERR_FILENO, ": ");
+  if (error != 0) {
+    ERROR(reason, (intptr_t)error);
+  }
+  ERROR(reason);
+
+} // fail ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Map a heap, at a given address if that is free.
+ *
+ * \param fd   The heap's file.
+ * \param name Its name, for errors.
+ * \param size Its size.
+ * \param hint The address at which to map it, or 0 for anywhere.
+ * \return     The mapping.
+ */
+static void* map_heap (int fd, const char* name, size_t size, uintptr_t hint) {
+
+  void* heap = mmap((void*)hint,
+		    size,
+		    PROT_READ | PROT_WRITE,
+		    MAP_SHARED | (hint != 0 ? MAP_FIXED_NOREPLACE : 0),
+		    fd,
+		    0);
+  if (heap == MAP_FAILED && hint != 0) {
+    heap = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (heap == MAP_FAILED) {
+    fail(name, "Could not mmap() heap");
+  }
+  return heap;
+
+} // map_heap ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* heapfile_open (const char* path, size_t size, uint64_t version, bool* created) {
+
+  // The descriptor is kept open, and so locked, for the life of the process.
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    fail(path, "Could not open heap file");
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+    fail(path, "Heap file is in use");
+  }
+  struct stat status;
+  if (fstat(fd, &status) == -1) {
+    fail(path, "Could not stat heap file");
+  }
+
+  // A new file is sized, and is then all zeros; so is one whose formatting was
+  // cut short.  An existing one must be a heap of the same layout, which is to
+  // be mapped where it was last, if possible.
+  heapfile_header_s header = { 0, 0, 0, 0 };
+  if (status.st_size != 0 &&
+      pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    errno = 0;
+    fail(path, "Not a heap file");
+  }
+  *created = (header.magic == 0);
+  if (status.st_size == 0) {
+    if (ftruncate(fd, size) == -1) {
+      fail(path, "Could not size heap file");
+    }
+  } else if (*created) {
+    size        = status.st_size;
+    header.base = 0;
+  } else {
+    if (header.magic != HEAPFILE_MAGIC || header.version != version ||
+	header.size != (size_t)status.st_size) {
+      errno = 0;
+      fail(path, "Not a heap file of this layout");
+    }
+    size = header.size;
+  }
+
+  void*              heap   = map_heap(fd, path, size, header.base);
+  heapfile_header_s* mapped = heap;
+  mapped->size = size;
+  mapped->base = (uintptr_t)heap;
+  return heap;
+
+} // heapfile_open ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void* heapfile_open_shared (const char* name, size_t size, uint64_t version, bool* created, int* fd) {
+
+  // Find or make the region.  Of the processes opening a named region, the one
+  // that creates it formats it.
+  *fd = -1;
+  if (strcmp(name, "memfd") == 0) {
+    *fd      = memfd_create("bf-alloc", 0);
+    *created = true;
+  } else if (name[0] == '/') {
+    *fd      = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    *created = (*fd != -1);
+    if (*fd == -1 && errno == EEXIST) {
+      *fd = shm_open(name, O_RDWR | O_CLOEXEC, 0600);
+    }
+  } else {
+    *created = false;
+    for (const char* digit = name; *digit >= '0' && *digit <= '9'; digit += 1) {
+      *fd = (*fd == -1 ? 0 : *fd * 10) + (*digit - '0');
+    }
+  }
+  if (*fd == -1) {
+    fail(name, "Could not open shared heap");
+  }
+
+  // A new region is sized, and is then all zeros.  Otherwise, wait for whoever
+  // created it to finish formatting it.
+  heapfile_header_s header = { 0, 0, 0, 0 };
+  if (*created) {
+    if (ftruncate(*fd, size) == -1) {
+      fail(name, "Could not size shared heap");
+    }
+  } else {
+    struct timespec pause = { 0, SHARED_FORMAT_PAUSE };
+    for (int tries = 0; header.magic != HEAPFILE_MAGIC; tries += 1) {
+      if (tries == SHARED_FORMAT_TRIES) {
+	errno = 0;
+	fail(name, "Shared heap was never formatted");
+      }
+      if (pread(*fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != HEAPFILE_MAGIC) {
+	nanosleep(&pause, NULL);
+      }
+    }
+    struct stat status;
+    if (fstat(*fd, &status) == -1 || header.version != version ||
+	header.size != (size_t)status.st_size) {
+      errno = 0;
+      fail(name, "Not a shared heap of this layout");
+    }
+    size = header.size;
+  }
+
+  // Every process tries to map the region where its creator did, so that even
+  // plain pointers into it may agree; offsets always do.
+  void* heap = map_heap(*fd, name, size, header.base);
+  if (*created) {
+    heapfile_header_s* mapped = heap;
+    mapped->size = size;
+    mapped->base = (uintptr_t)heap;
+  }
+
+  // A named region can be found again by its name, and needs no descriptor.
+  if (name[0] == '/') {
+    close(*fd);
+    *fd = -1;
+  }
+  return heap;
+
+} // heapfile_open_shared ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void heapfile_sync (void* addr, size_t length) {
+
+  uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t start     = (uintptr_t)addr & ~(page_size - 1);
+  if (msync((void*)start, (uintptr_t)addr + length - start, MS_SYNC) == -1) {
+    ERROR("heapfile_sync(): msync() failed", (intptr_t)addr, length);
+  }
+
+} // heapfile_sync ()
+// ==============================================================================
@@ -0,0 +1,128 @@
+// ==============================================================================
+/**
+ * heapfile.h
+ *
+ * Heaps kept in files, so that their contents outlive the process.  The file
+ * is mapped with `MAP_SHARED`, and begins with a header in which the allocator
+ * can keep whatever else it needs to find its blocks again.  Reopening the
+ * file maps it at the address it last had, if that address is free, and
+ * elsewhere otherwise; an allocator that links its blocks by offsets from the
+ * start of the mapping therefore does not care which.  While a process has
+ * the file open, it holds an exclusive lock on it, so that no other process
+ * can map the same heap.
+ *
+ * A heap can instead be shared by several processes at once, in a POSIX shared
+ * memory object or a `memfd`.  Whichever process creates the region formats
+ * it; the others wait for it to do so.  They then take turns, under a lock
+ * that the allocator keeps in its own header.  Nothing here allocates from the
+ * heap.
+ *
+ * bf-alloc keeps its heap in a file, or shares it, if built with
+ * `PERSISTENT_HEAP` and given `persist:<path>` or `shared:<name>` in its
+ * settings; see allocconf.h.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_HEAPFILE_H)
+#define _HEAPFILE_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES
+
+/** The start of every heap file.  The allocator's own header follows it. */
+typedef struct heapfile_header {
+
+  /** `HEAPFILE_MAGIC`, once the file has been formatted. */
+  uint64_t  magic;
+
+  /** The allocator's layout of the rest of the file. */
+  uint64_t  version;
+
+  /** The length of the file, which is the size of the heap. */
+  size_t    size;
+
+  /** The address at which the file was last mapped. */
+  uintptr_t base;
+
+} heapfile_header_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** Marks a formatted heap file ("HEAPFILE" in ASCII). */
+#define HEAPFILE_MAGIC 0x454c494650414548ULL
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Map a heap file, creating it if it does not exist.  A new file is given the
+ * requested size and is all zeros, magic included; it is up to the allocator
+ * to format it and then set its magic.  An existing file keeps its own size.
+ * Any failure (a file that is not a heap, or that is in use, or that cannot be
+ * mapped) is fatal.
+ *
+ * \param path    The file.
+ * \param size    The size for a new file.
+ * \param version The allocator's layout; an existing file must match it.
+ * \param created Where to store whether the file is new.
+ * \return        The mapping.  Its header gives its size, and records its
+ *                new address.
+ */
+void* heapfile_open (const char* path, size_t size, uint64_t version, bool* created);
+
+/**
+ * Map a shared heap, creating it if it does not exist.  As with a file, a new
+ * region is all zeros until the allocator formats it and then sets its magic;
+ * until then, any other process opening it waits.  Any failure is fatal.
+ *
+ * \param name    A POSIX shared memory object, as `/<name>`; `memfd` for a new
+ *                `memfd`, shared with children forked later or with any
+ *                process to which its descriptor is passed; or the number of
+ *                such a descriptor, already open.
+ * \param size    The size for a new region.
+ * \param version The allocator's layout; an existing region must match it.
+ * \param created Where to store whether the region is new.
+ * \param fd      Where to store the descriptor of a `memfd`, kept open so that
+ *                it can be passed on, or -1 for a named object.
+ * \return        The mapping.
+ */
+void* heapfile_open_shared (const char* name, size_t size, uint64_t version, bool* created, int* fd);
+
+/**
+ * Force a range of a mapped heap file out to the disk, returning only once it
+ * is there.  Ranges so flushed reach the disk in the order flushed.
+ *
+ * \param addr   The start of the range; need not be page-aligned.
+ * \param length Its length.
+ */
+void heapfile_sync (void* addr, size_t length);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _HEAPFILE_H
+// ==============================================================================
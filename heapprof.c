@@ -0,0 +1,359 @@
+// ==============================================================================
+/**
+ * heapprof.c
+ *
+ * A sampling heap profiler for the allocators.  Sampled blocks are kept in a
+ * fixed, open-addressed table keyed by address, and profiles are written with
+ * the `write()`-based functions of safeio, so that profiling never allocates.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heapprof.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** A sampled live block. */
+typedef struct sample {
+
+  /** The block, or `NULL` if this slot of the table is empty. */
+  void*  ptr;
+
+  /** The number of bytes requested for the block. */
+  size_t size;
+
+  /** The number of frames in `stack`. */
+  size_t depth;
+
+  /** The return addresses of the stack that allocated the block, innermost first. */
+  void*  stack[HEAPPROF_MAX_DEPTH];
+
+} sample_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS AND FUNCTIONS
+
+/** The index of the table slot at which the search for a block starts. */
+#define SLOT_OF(ptr) ((size_t)((((uintptr_t)(ptr) >> 4) * 0x9e3779b97f4a7c15ull) >> 32) % HEAPPROF_TABLE_SLOTS)
+
+/** The furthest apart that two consecutive frames are believed to be. */
+#define MAX_FRAME_SIZE (1024 * 1024)
+
+/** The size of the buffer through which `/proc/self/maps` is copied. */
+#define MAPS_BUFFER_SIZE 4096
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The number of bytes still to be allocated before the next sample. */
+intptr_t heapprof_countdown = HEAPPROF_DEFAULT_RATE;
+
+/** The mean number of bytes between samples, or 0 if sampling is off. */
+static size_t sample_rate = HEAPPROF_DEFAULT_RATE;
+
+/** The state of the random number generator that spaces the samples. */
+static uint64_t random_state = 0x2545f4914f6cdd1dull;
+
+/** The sampled live blocks. */
+static sample_s samples[HEAPPROF_TABLE_SLOTS];
+
+/** The number of sampled live blocks, and of samples dropped for want of room. */
+static size_t sample_count  = 0;
+static size_t dropped_count = 0;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Compute a natural logarithm without libm: split off the binary exponent, and
+ * approximate the log of the remaining mantissa with a short series.
+ *
+ * \param x A positive number.
+ * \return  An approximation of `ln(x)`, good to about 6 digits.
+ */
+static double fast_log (double x) {
+
+  union { double d; uint64_t u; } bits = { x };
+  int exponent = (int)((bits.u >> 52) & 0x7ff) - 1023;
+  bits.u       = (bits.u & ((1ull << 52) - 1)) | (1023ull << 52);
+
+  // ln(m) = 2 atanh((m - 1) / (m + 1)), with m in [1, 2).
+  double t  = (bits.d - 1) / (bits.d + 1);
+  double t2 = t * t;
+  double ln = 2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 / 9))));
+  return exponent * 0.6931471805599453 + ln;
+
+} // fast_log ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Choose the number of bytes to the next sample from an exponential
+ * distribution with mean `sample_rate`, so that each byte is equally likely to
+ * be the one sampled.
+ *
+ * \return The distance to the next sample.
+ */
+static intptr_t next_distance () {
+
+  if (sample_rate == 0) {
+    return INTPTR_MAX;
+  }
+
+  // xorshift64*, keeping the top 53 bits as a uniform variate in (0, 1].
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  uint64_t r    = (random_state * 0x2545f4914f6cdd1dull) >> 11;
+  double   u    = (double)(r + 1) / (double)(1ull << 53);
+
+  return (intptr_t)(-fast_log(u) * (double)sample_rate) + 1;
+
+} // next_distance ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Walk the chain of frame pointers from the caller of this function, recording
+ * each return address.  The walk stops at the first frame that does not look
+ * like the next one up the stack.
+ *
+ * \param stack Where to store the return addresses.
+ * \param max   The most addresses to store.
+ * \param skip  The number of innermost return addresses to leave out.
+ * \return      The number of addresses stored.
+ */
+static size_t __attribute__((noinline)) unwind (void** stack, size_t max, size_t skip) {
+
+  void** frame = __builtin_frame_address(0);
+  size_t depth = 0;
+  while (depth < max && frame != NULL) {
+
+    void* return_addr = frame[1];
+    if (return_addr == NULL) {
+      break;
+    }
+    if (skip > 0) {
+      skip -= 1;
+    } else {
+      stack[depth] = return_addr;
+      depth       += 1;
+    }
+
+    // The caller's frame must lie a little further up the stack.
+    void** next = frame[0];
+    if (next <= frame ||
+	(uintptr_t)next - (uintptr_t)frame > MAX_FRAME_SIZE ||
+	((uintptr_t)next & (sizeof(void*) - 1)) != 0) {
+      break;
+    }
+    frame = next;
+
+  }
+
+  return depth;
+
+} // unwind ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Set the mean number of bytes allocated between samples.
+ *
+ * \param rate The mean distance, in bytes, or 0 to stop sampling.
+ */
+void heapprof_set_rate (size_t rate) {
+
+  sample_rate        = rate;
+  heapprof_countdown = next_distance();
+
+} // heapprof_set_rate ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Record a sampled allocation, along with the stack that made it, and choose
+ * the distance to the next sample.
+ *
+ * \param ptr  The block allocated.
+ * \param size The number of bytes requested.
+ */
+void heapprof_record (void* ptr, size_t size) {
+
+  heapprof_countdown = next_distance();
+
+  if (sample_count == HEAPPROF_TABLE_SLOTS - 1) {
+    dropped_count += 1;
+    return;
+  }
+
+  size_t slot = SLOT_OF(ptr);
+  while (samples[slot].ptr != NULL) {
+    slot = (slot + 1) % HEAPPROF_TABLE_SLOTS;
+  }
+  samples[slot].ptr   = ptr;
+  samples[slot].size  = size;
+  samples[slot].depth = unwind(samples[slot].stack, HEAPPROF_MAX_DEPTH, 1);  // not this function
+  sample_count       += 1;
+
+} // heapprof_record ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Drop the record of a block, if it was sampled.  The slots after it are
+ * shifted back as needed so that no search runs into an empty slot early.
+ *
+ * \param ptr The block.
+ */
+void heapprof_forget (void* ptr) {
+
+  if (sample_count == 0 || ptr == NULL) {
+    return;
+  }
+
+  size_t slot = SLOT_OF(ptr);
+  while (samples[slot].ptr != ptr) {
+    if (samples[slot].ptr == NULL) {
+      return;
+    }
+    slot = (slot + 1) % HEAPPROF_TABLE_SLOTS;
+  }
+
+  // Fill the hole with any later entry whose home slot does not lie between
+  // the hole and that entry.
+  size_t hole = slot;
+  size_t next = (hole + 1) % HEAPPROF_TABLE_SLOTS;
+  while (samples[next].ptr != NULL) {
+    size_t home = SLOT_OF(samples[next].ptr);
+    bool   stays = (hole < next) ? (hole < home && home <= next) : (hole < home || home <= next);
+    if (!stays) {
+      samples[hole] = samples[next];
+      hole          = next;
+    }
+    next = (next + 1) % HEAPPROF_TABLE_SLOTS;
+  }
+  samples[hole].ptr = NULL;
+  sample_count     -= 1;
+
+} // heapprof_forget ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write one `<count>: <bytes> [<count>: <bytes>]` pair of columns.
+ *
+ * \param fd    The file descriptor.
+ * \param count The number of blocks.
+ * \param bytes The bytes they span.
+ */
+static void write_counts (int fd, size_t count, size_t bytes) {
+
+  for (int i = 0; i < 2; i += 1) {
+    safe_write(fd, i == 0 ? "" : " [");
+    safe_write_dec(fd, count);
+    safe_write(fd, ": ");
+    safe_write_dec(fd, bytes);
+  }
+  safe_write(fd, "]");
+
+} // write_counts ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write the sampled live blocks to a file descriptor as a legacy pprof heap
+ * profile.  The `heap_v2` header carries the sampling rate, from which pprof
+ * scales each sample back up to an estimate of the whole heap.  The process's
+ * mappings follow, so that pprof can symbolize the addresses.
+ *
+ * \param fd The file descriptor.
+ */
+void heapprof_dump (int fd) {
+
+  size_t total_bytes = 0;
+  for (size_t slot = 0; slot < HEAPPROF_TABLE_SLOTS; slot += 1) {
+    if (samples[slot].ptr != NULL) {
+      total_bytes += samples[slot].size;
+    }
+  }
+
+  safe_write(fd, "heap profile: ");
+  write_counts(fd, sample_count, total_bytes);
+  safe_write(fd, " @ heap_v2/");
+  safe_write_dec(fd, sample_rate);
+  safe_write(fd, "\n");
+
+  // One line per sample; pprof merges those with the same stack.
+  for (size_t slot = 0; slot < HEAPPROF_TABLE_SLOTS; slot += 1) {
+    sample_s* sample = &samples[slot];
+    if (sample->ptr == NULL) {
+      continue;
+    }
+    write_counts(fd, 1, sample->size);
+    safe_write(fd, " @");
+    for (size_t i = 0; i < sample->depth; i += 1) {
+      safe_write(fd, " ");
+      safe_write_hex(fd, (uintptr_t)sample->stack[i]);
+    }
+    safe_write(fd, "\n");
+  }
+
+  // The profile has nowhere to say that it is incomplete, so say so aside.
+  if (dropped_count != 0) {
+    safe_write(STDERR_FILENO, "heapprof: ");
+    safe_write_dec(STDERR_FILENO, dropped_count);
+    safe_write(STDERR_FILENO, " samples dropped for lack of room; the profile is incomplete\n");
+  }
+
+  // Copy the mappings verbatim.
+  safe_write(fd, "\nMAPPED_LIBRARIES:\n");
+  int maps = open("/proc/self/maps", O_RDONLY);
+  if (maps == -1) {
+    return;
+  }
+  char    buffer[MAPS_BUFFER_SIZE];
+  ssize_t length;
+  while ((length = read(maps, buffer, MAPS_BUFFER_SIZE)) > 0) {
+    write(fd, buffer, length);
+  }
+  close(maps);
+
+} // heapprof_dump ()
+// ==============================================================================
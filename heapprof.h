@@ -0,0 +1,125 @@
+// ==============================================================================
+/**
+ * heapprof.h
+ *
+ * A sampling heap profiler for the allocators.  Roughly one allocation per
+ * `rate` bytes is sampled, with a geometrically distributed distance between
+ * samples, and the call stack of each sampled block is recorded until it is
+ * freed.  Nothing here allocates from the heap.
+ *
+ * Sampling is compiled into `malloc()` and `free()` only if `HEAP_PROFILE` is
+ * defined.  Stacks are found by following frame pointers, so the program being
+ * profiled should be compiled with `-fno-omit-frame-pointer`.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_HEAPPROF_H)
+#define _HEAPPROF_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The default mean number of bytes allocated between samples. */
+#define HEAPPROF_DEFAULT_RATE (512 * 1024)
+
+/** The most frames recorded for each sample. */
+#define HEAPPROF_MAX_DEPTH 32
+
+/** The most sampled blocks that can be live at once. */
+#define HEAPPROF_TABLE_SLOTS 4096
+
+/** Hooks for `malloc()` and `free()` (or, if disabled, nothing). */
+#if defined (HEAP_PROFILE)
+#define HEAPPROF_MALLOC(ptr,size)					\
+  do {									\
+    if ((ptr) != NULL && heapprof_due(size)) {				\
+      heapprof_record((ptr), (size));					\
+    }									\
+  } while (0)
+#define HEAPPROF_FREE(ptr) heapprof_forget(ptr)
+#else
+#define HEAPPROF_MALLOC(ptr,size)
+#define HEAPPROF_FREE(ptr)
+#endif /* HEAP_PROFILE */
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The number of bytes still to be allocated before the next sample. */
+extern intptr_t heapprof_countdown;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count an allocation against the distance to the next sample.
+ *
+ * \param size The number of bytes allocated.
+ * \return     `true` if the allocation should be sampled.
+ */
+static inline bool heapprof_due (size_t size) {
+
+  heapprof_countdown -= (intptr_t)size;
+  return heapprof_countdown < 0;
+
+} // heapprof_due ()
+
+/**
+ * Set the mean number of bytes allocated between samples.
+ *
+ * \param rate The mean distance, in bytes, or 0 to stop sampling.
+ */
+void heapprof_set_rate (size_t rate);
+
+/**
+ * Record a sampled allocation, along with the stack that made it, and choose
+ * the distance to the next sample.
+ *
+ * \param ptr  The block allocated.
+ * \param size The number of bytes requested.
+ */
+void heapprof_record (void* ptr, size_t size);
+
+/**
+ * Drop the record of a block, if it was sampled, because it is being freed.
+ *
+ * \param ptr The block.
+ */
+void heapprof_forget (void* ptr);
+
+/**
+ * Write the sampled live blocks to a file descriptor as a legacy pprof heap
+ * profile, followed by the process's memory mappings.
+ *
+ * \param fd The file descriptor.
+ */
+void heapprof_dump (int fd);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _HEAPPROF_H
+// ==============================================================================
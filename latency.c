@@ -0,0 +1,222 @@
+// ==============================================================================
+/**
+ * latency.c
+ *
+ * Per-operation latency histograms.  Each thread claims a set of histograms,
+ * one per code path, on its first timed operation and is then the only writer
+ * of them, so counting takes no lock.  Dumping merges every thread's
+ * histograms as they stand, which may miss operations still being counted.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "latency.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES AND STRUCTURES
+
+/** A thread's histograms. */
+typedef struct histograms {
+
+  /** The operations on each path that took each bucket's range of ticks. */
+  uint64_t counts[LATENCY_PATHS][LATENCY_BUCKETS];
+
+  /** The longest operation on each path. */
+  uint64_t max[LATENCY_PATHS];
+
+} histograms_s;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The path taken by the operation being timed on this thread. */
+__thread latency_path_e latency_path = LATENCY_FREE_LIST_HIT;
+
+/** This thread's histograms, and whether there were none left for it. */
+static __thread histograms_s* my_histograms = NULL;
+static __thread bool          unhistogrammed = false;
+
+/** The histograms; the first `histograms_claimed` of them belong to threads. */
+static histograms_s histograms[LATENCY_MAX_THREADS];
+static unsigned int histograms_claimed = 0;
+
+/** The name of each path, as dumped. */
+static const char* path_names[LATENCY_PATHS] = {
+  "free-list-hit",
+  "bump",
+  "refill",
+  "large-cache",
+  "mmap",
+  "free"
+};
+
+/** The percentiles dumped, in thousandths. */
+static const unsigned int percentiles[] = { 500, 900, 990, 999 };
+static const char*        percentile_names[] = { "p50", "p90", "p99", "p999" };
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Find the bucket for a duration.  Below `1 << LATENCY_SUB_BITS` ticks, each
+ * tick has its own bucket; above, each power of 2 is split evenly.
+ */
+static unsigned int bucket_of (uint64_t ticks) {
+
+  if (ticks < (1 << LATENCY_SUB_BITS)) {
+    return ticks;
+  }
+  unsigned int log = 63 - __builtin_clzll(ticks);
+  return ((log - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) +
+         ((ticks >> (log - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+
+} // bucket_of ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/** The least duration that falls in a bucket. */
+static uint64_t bucket_floor (unsigned int bucket) {
+
+  if (bucket < (1 << LATENCY_SUB_BITS)) {
+    return bucket;
+  }
+  unsigned int log = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+  uint64_t     sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+  return (((uint64_t)1 << LATENCY_SUB_BITS) + sub) << (log - LATENCY_SUB_BITS);
+
+} // bucket_floor ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void latency_record (latency_path_e path, uint64_t ticks) {
+
+  histograms_s* mine = my_histograms;
+  if (mine == NULL) {
+    if (unhistogrammed) {
+      return;
+    }
+    unsigned int index = __atomic_fetch_add(&histograms_claimed, 1, __ATOMIC_ACQ_REL);
+    if (index >= LATENCY_MAX_THREADS) {
+      unhistogrammed = true;
+      return;
+    }
+    mine = my_histograms = &histograms[index];
+  }
+
+  mine->counts[path][bucket_of(ticks)] += 1;
+  if (ticks > mine->max[path]) {
+    mine->max[path] = ticks;
+  }
+
+} // latency_record ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void latency_dump (int fd) {
+
+  unsigned int claimed = __atomic_load_n(&histograms_claimed, __ATOMIC_ACQUIRE);
+  if (claimed > LATENCY_MAX_THREADS) {
+    claimed = LATENCY_MAX_THREADS;
+  }
+
+  safe_write(fd, "latency: ticks are ");
+#if defined (__x86_64__)
+  safe_write(fd, "TSC cycles\n");
+#else
+  safe_write(fd, "nanoseconds\n");
+#endif
+
+  for (unsigned int path = 0; path < LATENCY_PATHS; path += 1) {
+
+    // Merge the threads' histograms for this path, on the stack.
+    uint64_t merged[LATENCY_BUCKETS] = { 0 };
+    uint64_t count                   = 0;
+    uint64_t max                     = 0;
+    for (unsigned int thread = 0; thread < claimed; thread += 1) {
+      for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket += 1) {
+	uint64_t n      = histograms[thread].counts[path][bucket];
+	merged[bucket] += n;
+	count          += n;
+      }
+      if (histograms[thread].max[path] > max) {
+	max = histograms[thread].max[path];
+      }
+    }
+    if (count == 0) {
+      continue;
+    }
+
+    // The summary line, with the percentiles found in the merged histogram.
+    safe_write(fd, "latency: ");
+    safe_write(fd, path_names[path]);
+    safe_write(fd, " count=");
+    safe_write_dec(fd, count);
+    uint64_t     seen = 0;
+    unsigned int next = 0;
+    for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket += 1) {
+      seen += merged[bucket];
+      while (next < sizeof(percentiles) / sizeof(percentiles[0]) &&
+	     seen > 0 && seen * 1000 >= count * percentiles[next]) {
+	safe_write(fd, " ");
+	safe_write(fd, percentile_names[next]);
+	safe_write(fd, "=");
+	safe_write_dec(fd, bucket_floor(bucket));
+	next += 1;
+      }
+    }
+    safe_write(fd, " max=");
+    safe_write_dec(fd, max);
+    safe_write(fd, "\n");
+
+    // The buckets.
+    for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket += 1) {
+      if (merged[bucket] != 0) {
+	safe_write(fd, "  ");
+	safe_write_dec(fd, bucket_floor(bucket));
+	safe_write(fd, "\t");
+	safe_write_dec(fd, merged[bucket]);
+	safe_write(fd, "\n");
+      }
+    }
+
+  }
+
+} // latency_dump ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write the histograms to `stderr` at exit, if anything was timed.
+ */
+static void __attribute__((destructor)) latency_at_exit () {
+
+  if (__atomic_load_n(&histograms_claimed, __ATOMIC_ACQUIRE) > 0) {
+    latency_dump(STDERR_FILENO);
+  }
+
+} // latency_at_exit ()
+// ==============================================================================
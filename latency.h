@@ -0,0 +1,151 @@
+// ==============================================================================
+/**
+ * latency.h
+ *
+ * Per-operation latency histograms for the allocators.  Each `malloc()` and
+ * `free()` is timed with the CPU's timestamp counter and counted in a
+ * histogram for the code path it took, so that rare, slow operations (a long
+ * free-list walk, a run refill, a fresh mapping) stand out instead of
+ * vanishing into an average.  Each thread counts into its own histograms, and
+ * nothing here allocates from the heap.
+ *
+ * Timing is compiled into the allocators only if `ALLOC_LATENCY` is defined.
+ * The histograms are written to `stderr` at exit, or to any file descriptor on
+ * demand by `latency_dump()`.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_LATENCY_H)
+#define _LATENCY_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+#include <time.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// TYPES
+
+/** The code paths timed separately. */
+typedef enum latency_path {
+
+  /** An allocation satisfied by a block already on a free list. */
+  LATENCY_FREE_LIST_HIT = 0,
+
+  /** An allocation satisfied by bumping the end of the heap. */
+  LATENCY_BUMP,
+
+  /** An allocation that had to carve out a new run first. */
+  LATENCY_REFILL,
+
+  /** A large allocation satisfied from the cache of unmapped regions. */
+  LATENCY_LARGE_CACHE,
+
+  /** A large allocation that needed a fresh mapping. */
+  LATENCY_MMAP,
+
+  /** A deallocation. */
+  LATENCY_FREE,
+
+  LATENCY_PATHS
+
+} latency_path_e;
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** Each power of 2 is split into `1 << LATENCY_SUB_BITS` buckets... */
+#define LATENCY_SUB_BITS 3
+
+/** ...for this many buckets in all, enough for any 64-bit count. */
+#define LATENCY_BUCKETS  ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+/** The most threads whose histograms are kept; later threads go untimed. */
+#define LATENCY_MAX_THREADS 64
+
+/**
+ * Hooks for timing an operation (or, if disabled, nothing).  Begin timing with
+ * the path the operation takes by default, reclassify it wherever it turns out
+ * to take another, and end timing just before it returns.
+ */
+#if defined (ALLOC_LATENCY)
+#define LATENCY_BEGIN(path)				\
+  uint64_t latency_start = latency_now();		\
+  latency_path = (path)
+#define LATENCY_PATH(path) (latency_path = (path))
+#define LATENCY_END() latency_record(latency_path, latency_now() - latency_start)
+#else
+#define LATENCY_BEGIN(path)
+#define LATENCY_PATH(path)
+#define LATENCY_END()
+#endif /* ALLOC_LATENCY */
+// ==============================================================================
+
+
+
+// ==============================================================================
+// GLOBALS
+
+/** The path taken by the operation being timed on this thread. */
+extern __thread latency_path_e latency_path;
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Read the timestamp counter: cycles on x86-64, or nanoseconds elsewhere.
+ *
+ * \return The current count.
+ */
+static inline uint64_t latency_now () {
+
+#if defined (__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+
+} // latency_now ()
+
+/**
+ * Count one timed operation in the calling thread's histograms.
+ *
+ * \param path  The code path it took.
+ * \param ticks Its duration, in timestamp counter ticks.
+ */
+void latency_record (latency_path_e path, uint64_t ticks);
+
+/**
+ * Write the histograms of every thread, merged, to a file descriptor: for
+ * each path taken, a summary line of its count, percentiles, and maximum,
+ * followed by a line for each non-empty bucket giving its least duration and
+ * count.
+ *
+ * \param fd The file descriptor.
+ */
+void latency_dump (int fd);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _LATENCY_H
+// ==============================================================================
@@ -0,0 +1,127 @@
+// ==============================================================================
+/**
+ * numabind.c
+ *
+ * Node-local placement for the allocators, by way of the `getcpu()` and
+ * `mbind()` system calls and the node list in sysfs.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#include "allocconf.h"
+#include "numabind.h"
+#include "safeio.h"
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACRO CONSTANTS
+
+/** Where the kernel lists the online nodes, as ranges such as `0-1,3`. */
+#define ONLINE_NODES "/sys/devices/system/node/online"
+
+/** The most characters of that list read. */
+#define MAX_NODE_LIST 256
+// ==============================================================================
+
+
+
+// ==============================================================================
+int numabind_nodes () {
+
+  int fd = open(ONLINE_NODES, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return 1;
+  }
+  char    list[MAX_NODE_LIST];
+  ssize_t length = read(fd, list, sizeof(list));
+  close(fd);
+
+  // The highest node is the last number in the list.
+  int highest = -1;
+  int number  = -1;
+  for (ssize_t i = 0; i < length; i += 1) {
+    if (list[i] >= '0' && list[i] <= '9') {
+      number = (number < 0 ? 0 : number * 10) + (list[i] - '0');
+    } else {
+      if (number > highest) {
+	highest = number;
+      }
+      number = -1;
+    }
+  }
+  if (number > highest) {
+    highest = number;
+  }
+  return highest < 0 ? 1 : highest + 1;
+
+} // numabind_nodes ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int numabind_current_node () {
+
+  unsigned int cpu  = 0;
+  unsigned int node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == -1) {
+    return 0;
+  }
+  return (int)node;
+
+} // numabind_current_node ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+int numabind_resolve (int node) {
+
+  int nodes = numabind_nodes();
+  if (node == ALLOC_NUMA_OFF || nodes <= 1) {
+    return ALLOC_NUMA_OFF;
+  }
+  if (node == ALLOC_NUMA_LOCAL) {
+    node = numabind_current_node();
+  }
+  if (node < 0 || node >= nodes || node >= NUMABIND_MAX_NODES) {
+    safe_write(STDERR_FILENO, "numabind: No such node as ");
+    safe_write_dec(STDERR_FILENO, node);
+    safe_write(STDERR_FILENO, "; leaving memory unbound\n");
+    return ALLOC_NUMA_OFF;
+  }
+  return node;
+
+} // numabind_resolve ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+void numabind_bind (void* addr, size_t length, int node) {
+
+  if (node == ALLOC_NUMA_OFF) {
+    return;
+  }
+
+  // The mask has one bit per node, and the kernel is told its length in bits
+  // plus one.
+  unsigned long mask = 1UL << node;
+  if (syscall(SYS_mbind, addr, length, MPOL_PREFERRED, &mask, 8 * sizeof(mask) + 1, 0) == -1) {
+    DEBUG("numabind_bind(): mbind() failed", (intptr_t)addr, length, (intptr_t)node);
+  }
+
+} // numabind_bind ()
+// ==============================================================================
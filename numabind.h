@@ -0,0 +1,99 @@
+// ==============================================================================
+/**
+ * numabind.h
+ *
+ * Node-local placement of the allocators' memory on NUMA machines.  Each
+ * allocator keeps a single heap, so the heap as a whole is bound to one node:
+ * either a given node, or the node of the CPU running the thread that first
+ * allocates (`numa:local` in the allocator's settings; see allocconf.h).  The
+ * binding is made with `mbind()` before any page of the heap is touched, and
+ * is a preference, not a requirement: if the node runs out of memory, pages
+ * come from elsewhere.  Large blocks mapped on their own are bound the same
+ * way.  On a machine with a single node, or if the kernel refuses, nothing is
+ * bound and the allocators behave as before.  Nothing here allocates from the
+ * heap, and no NUMA library is needed.
+ *
+ * Binding is compiled into the allocators only if `NUMA_AWARE` is defined.
+ **/
+// ==============================================================================
+
+
+
+// ==============================================================================
+// Avoid multiple inclusion.
+
+#if !defined (_NUMABIND_H)
+#define _NUMABIND_H
+// ==============================================================================
+
+
+
+// ==============================================================================
+// INCLUDES
+
+#include <stddef.h>
+// ==============================================================================
+
+
+
+// ==============================================================================
+// MACROS
+
+/** The most nodes that can be named; higher nodes are left unbound. */
+#define NUMABIND_MAX_NODES 64
+
+/** Hooks for the allocators (or, if disabled, nothing). */
+#if defined (NUMA_AWARE)
+#define NUMABIND_RESOLVE(node)              numabind_resolve(node)
+#define NUMABIND_BIND(addr, length, node)   numabind_bind((addr), (length), (node))
+#else
+#define NUMABIND_RESOLVE(node)              (node)
+#define NUMABIND_BIND(addr, length, node)
+#endif /* NUMA_AWARE */
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Count the machine's nodes.
+ *
+ * \return The number of the highest online node, plus one; 1 if unknown.
+ */
+int numabind_nodes ();
+
+/**
+ * Find the node of the CPU running the calling thread.
+ *
+ * \return The node, or 0 if unknown.
+ */
+int numabind_current_node ();
+
+/**
+ * Decide which node a heap should be bound to.  A warning is written to
+ * `stderr` if the node named does not exist.
+ *
+ * \param node The node named in the settings, `ALLOC_NUMA_LOCAL`, or
+ *             `ALLOC_NUMA_OFF`.
+ * \return     The node, or `ALLOC_NUMA_OFF` if nothing is to be bound: if so
+ *             configured, if the machine has a single node, or if the node
+ *             does not exist.
+ */
+int numabind_resolve (int node);
+
+/**
+ * Prefer a node for the pages of a mapping not yet touched.  Failure is
+ * ignored; the pages are then placed as the kernel sees fit.
+ *
+ * \param addr   The start of the mapping; page-aligned.
+ * \param length Its length.
+ * \param node   The node, as returned by `numabind_resolve()`.
+ */
+void numabind_bind (void* addr, size_t length, int node);
+// ==============================================================================
+
+
+
+// ==============================================================================
+#endif // _NUMABIND_H
+// ==============================================================================
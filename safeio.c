@@ -46,6 +46,9 @@
 #define NEWLINE_LENGTH 1
 
 #define OUTPUT_FD  STDERR_FILENO
+
+/** The most decimal digits that a 64-bit value can have. */
+#define MAX_DECIMAL_DIGITS 20
 // ==============================================================================
 
 
@@ -77,6 +80,27 @@ int_to_hex (char* buffer, uint64_t value) {
 
 
 
+// ==============================================================================
+void
+int_to_dec (char* buffer, uint64_t value) {
+
+  // Fill in the digits from the end of a scratch buffer, then copy them out.
+  char  digits[MAX_DECIMAL_DIGITS];
+  char* current = digits + MAX_DECIMAL_DIGITS;
+  do {
+    *--current = '0' + (value % 10);
+    value      = value / 10;
+  } while (value != 0);
+
+  size_t length = digits + MAX_DECIMAL_DIGITS - current;
+  memcpy(buffer, current, length);
+  buffer[length] = '\0';
+
+} // int_to_dec ()
+// ==============================================================================
+
+
+
 // ==============================================================================
 /**
  * Print a message.
@@ -159,3 +183,59 @@ safe_error (const char* msg, int argc, ...) {
   
 } // safe_error ()
 // ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write a string to a file descriptor.
+ *
+ * \param fd     The file descriptor.
+ * \param string The string to write.  Cannot be longer than 256 characters.
+ */
+void
+safe_write (int fd, const char* string) {
+
+  write(fd, string, strnlen(string, MAX_MESSAGE_LENGTH));
+
+} // safe_write ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write an unsigned integer to a file descriptor in decimal.
+ *
+ * \param fd    The file descriptor.
+ * \param value The value to write.
+ */
+void
+safe_write_dec (int fd, uint64_t value) {
+
+  char buffer[MAX_DECIMAL_DIGITS + 1];
+  int_to_dec(buffer, value);
+  write(fd, buffer, strlen(buffer));
+
+} // safe_write_dec ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write an unsigned integer to a file descriptor in hexadecimal, with a `0x`
+ * prefix.
+ *
+ * \param fd    The file descriptor.
+ * \param value The value to write.
+ */
+void
+safe_write_hex (int fd, uint64_t value) {
+
+  char buffer[NYBBLES_PER_WORD + 3] = "0x";
+  int_to_hex(buffer + 2, value);
+  write(fd, buffer, strlen(buffer));
+
+} // safe_write_hex ()
+// ==============================================================================
@@ -17,6 +17,14 @@
 
 
 
+// ==============================================================================
+// INCLUDES
+
+#include <stdint.h>
+// ==============================================================================
+
+
+
 // ==============================================================================
 // MACROS
 
@@ -57,6 +65,31 @@ void safe_debug (const char* msg, int argc, ...);
  *             the output.
  */
 void safe_error (const char* msg, int argc, ...);
+
+/**
+ * Write a string to a file descriptor.
+ *
+ * \param fd     The file descriptor.
+ * \param string The string to write.  Cannot be longer than 256 characters.
+ */
+void safe_write (int fd, const char* string);
+
+/**
+ * Write an unsigned integer to a file descriptor in decimal.
+ *
+ * \param fd    The file descriptor.
+ * \param value The value to write.
+ */
+void safe_write_dec (int fd, uint64_t value);
+
+/**
+ * Write an unsigned integer to a file descriptor in hexadecimal, with a `0x`
+ * prefix.
+ *
+ * \param fd    The file descriptor.
+ * \param value The value to write.
+ */
+void safe_write_hex (int fd, uint64_t value);
 // ==============================================================================
 
 
@@ -4,9 +4,49 @@
  *
  * A _segregated-fits_ heap allocator.  This allocator uses _power-of-2 class
  * sizes_ of _singly-linked free lists_.  Each allocation is "rounded up" to its
- * class size, and the first available free block allocated from that free list.
- * If the list does not contain any blocks, a page is allocated and used to
- * populate that free list.
+ * class size, and the first available free block allocated from that class.
+ * The free blocks of each class are sharded into one free list per page (or
+ * _run_, below), and allocation drains one page before moving to the next, so
+ * that consecutive allocations stay close together.  If none of the class's
+ * pages has a free block, a new page is allocated and used to populate it.
+ *
+ * Requests above the largest small class, up to 1 MB, are served from a
+ * _medium_ tier of quarter-power-of-2 classes, each populated from a multi-page
+ * _run_ carved out of the heap.  Only larger requests are given their own
+ * mappings.  The size class of every heap page is kept in a separate _page
+ * map_, so that the pages themselves carry no headers.
+ *
+ * Each run counts its live blocks, and each size class keeps a list of its
+ * _partial_ runs, those with free blocks.  Once a class holds enough empty
+ * runs, any further run that empties leaves its class and is returned to a
+ * _page pool_, from which any class may carve new runs, and its pages are
+ * handed back to the kernel.
+ *
+ * Runs of blocks of 1 KB or more are _colored_, as in Bonwick's slab allocator:
+ * the first block of each run is offset from the start of the run by a number
+ * of cache lines that rotates from one run to the next, using the slack left
+ * at the end of the run.  The blocks of successive runs thus map to different
+ * cache sets, rather than all competing for the same few.  Runs of at least
+ * `COLOR_RUN_BLOCKS` blocks that would otherwise have no slack give up a block
+ * for it.
+ *
+ * Each allocation prefetches the block that the next allocation from its run
+ * will take, so that popping a free list does not stall on a cold link.
+ *
+ * If compiled with `SLAB_BITMAP`, free blocks are instead tracked by a bitmap
+ * of free slots in each run's descriptor, so that `free()` never writes into
+ * the freed block; each allocation then prefetches the block that it returns.
+ *
+ * The heap size, the threshold above which requests are mapped separately,
+ * whether every block is given whole cache lines, and whether runs are colored
+ * can be set at runtime through `SFALLOC_CONF`; see allocconf.h.
+ *
+ * If compiled with `GUARD_POOL`, a sample of allocations is served from a pool
+ * of guard pages instead, to catch overflows and uses after free; see
+ * guardpool.h.
+ *
+ * If compiled with `NUMA_AWARE`, the heap and large blocks can be placed on a
+ * chosen NUMA node; see numabind.h.
  **/
 // ==============================================================================
 
@@ -17,6 +57,7 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <malloc.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -25,6 +66,17 @@
 #include <unistd.h>
 #include <sys/mman.h>
 
+#if defined (SLAB_BITMAP) && defined (__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "alloc.h"
+#include "allocconf.h"
+#include "alloctrace.h"
+#include "guardpool.h"
+#include "heapprof.h"
+#include "latency.h"
+#include "numabind.h"
 #include "safeio.h"
 // ==============================================================================
 
@@ -33,6 +85,12 @@
 // ==============================================================================
 // TYPES AND STRUCTURES
 
+/**
+ * The number of 64-bit words in each run's free slot bitmap: enough for a page
+ * of 4 KB filled with blocks of the smallest class.
+ */
+#define SLAB_BITMAP_WORDS 4
+
 /** The header for each free object. */
 typedef struct header {
 
@@ -40,6 +98,84 @@ typedef struct header {
   struct header* next;
 
 } header_s;
+
+/**
+ * The descriptor for each page of the heap, kept in the page map.  Only the
+ * descriptor of the first page of a run tracks the run as a whole; for a run in
+ * the page pool, the descriptor of its last page also records its length.
+ */
+typedef struct page {
+
+  /** The size class of the blocks in the run, or `POOL_CLASS` if pooled. */
+  unsigned int size_class;
+
+  /** The number of pages between the start of the run and this page. */
+  unsigned int run_offset;
+
+  /** The number of pages in the run. */
+  unsigned int run_pages;
+
+  /** The number of allocated blocks in the run. */
+  unsigned int live;
+
+  /** The offset in bytes of the run's first block: the run's _color_. */
+  unsigned int color;
+
+  /** The next run in the same page pool list or partial run list. */
+  struct page* next;
+
+  /** The previous run in the same page pool list or partial run list. */
+  struct page* prev;
+
+#if defined (SLAB_BITMAP)
+  /** The number of blocks that fit in the run. */
+  unsigned int slots;
+
+  /** A bitmap of the run's free slots, the lowest bit being the first slot. */
+  uint64_t     free_slots[SLAB_BITMAP_WORDS];
+#else
+  /** The head of the run's own free list. */
+  header_s*    free_list;
+#endif
+
+} page_s;
+
+/** A cached large mapping, kept around after `free()` for later reuse. */
+typedef struct large_entry {
+
+  /** The base address of the mapping, or 0 if this slot is empty. */
+  intptr_t addr;
+
+  /** The length of the mapping in bytes (a multiple of the page size). */
+  size_t   length;
+
+  /** The value of the large-operation clock when this entry was cached. */
+  size_t   stamp;
+
+} large_entry_s;
+
+/** A pool of fixed-size objects, with runs of its own. */
+struct object_pool {
+
+  /** The distance between consecutive objects in a run. */
+  size_t    stride;
+
+  /** The number of pages in each of the pool's runs. */
+  size_t    run_pages;
+
+  /** The objects returned by `pool_free()`, most recent first. */
+  header_s* free_list;
+
+  /** The next never-used object in the newest run... */
+  intptr_t  bump;
+
+  /** ...and the end of the objects in that run. */
+  intptr_t  bump_end;
+
+  /** The pool's runs, linked through their descriptors' `next` fields. */
+  page_s*   runs;
+
+};
 // ==============================================================================
 
 
@@ -47,8 +183,8 @@ typedef struct header {
 // ==============================================================================
 // MACRO CONSTANTS AND FUNCTIONS
 
-/** The system's page size. */
-#define PAGE_SIZE sysconf(_SC_PAGESIZE)
+/** The system's page size, cached at initialization. */
+#define PAGE_SIZE page_size
 
 /** Mask of the offset bits of a virtual address. */
 #define OFFSET_MASK (PAGE_SIZE - 1)
@@ -61,32 +197,167 @@ typedef struct header {
 #define MB(size)  (KB(size) * 1024)
 #define GB(size)  (MB(size) * 1024)
 
-/** The virtual address space reserved for the heap. */
-#define HEAP_SIZE GB(2)
+/** The virtual address space reserved for the heap, configured at initialization. */
+#define HEAP_SIZE conf.heap_size
+
+/** The heap size used unless configured otherwise. */
+#define DEFAULT_HEAP_SIZE GB(2)
 
 /** The smallest size class, 16 bytes (a double-word). */
 #define MIN_SIZE_CLASS 4
 
-/** The largest size class, 2048 bytes (half-page). */
+/**
+ * The size class of a cache line, `ALLOC_CACHE_LINE` bytes.  Since runs start on
+ * page boundaries, and are colored by whole lines, the blocks of this class and
+ * every larger one are aligned to cache lines and span whole lines.
+ */
+#define CACHE_LINE_CLASS 6
+
+/** The largest small size class, 2048 bytes (half-page). */
 #define MAX_SIZE_CLASS 11
 
+/** The smallest colored size class, 1 KB. */
+#define MIN_COLORED_CLASS 10
+
+/**
+ * The number of blocks in each run of the small colored classes, and the
+ * fewest in a run that gives up a block to make room for colors.
+ */
+#define COLOR_RUN_BLOCKS 16
+
+/**
+ * The number of medium size classes between each power of 2, so that medium
+ * blocks are rounded up by at most 25%.
+ */
+#define MEDIUM_CLASSES_PER_DOUBLING 4
+
+/** The largest medium size class, 1 MB; anything larger is mapped separately. */
+#define MAX_MEDIUM_CLASS (MAX_SIZE_CLASS + 9 * MEDIUM_CLASSES_PER_DOUBLING)
+
+/** The largest request that can be served from the heap... */
+#define MAX_MEDIUM_SIZE MB(1)
+
+/** ...and the largest that is, configured at initialization. */
+#define MMAP_THRESHOLD conf.mmap_threshold
+
+/** The pseudo-class of requests too large for the heap. */
+#define LARGE_CLASS (MAX_MEDIUM_CLASS + 1)
+
+/** The target length of a run of medium blocks. */
+#define MEDIUM_RUN_BYTES KB(128)
+
 /** Calculate the log of a size-1, used to determine the size class. */
 #define CALC_SIZE_CLASS(x) ((unsigned int) (8*sizeof(size_t) - __builtin_clzll((x - 1))))
 
-/** Calculate the size of a block in a given size class, given as 2^class. */
+/** Calculate the size of a block in a given small size class, given as 2^class. */
 #define CALC_CLASS_SIZE(x) (1 << x)
 
+/** Given an address in the heap, find the index of its page in the page map. */
+#define PAGE_INDEX(addr) ((size_t)(((intptr_t)(addr) - start_addr) >> page_shift))
+
+/** Given the descriptor of a page, find the address of that page. */
+#define PAGE_ADDR(pp) (start_addr + ((intptr_t)((pp) - page_map) << page_shift))
+
+/** Given a pointer to a block, look up the size class of its page. */
+#define GET_SIZE_CLASS(bp) (page_map[PAGE_INDEX(bp)].size_class)
+
+/** Round a byte count up to a whole number of pages. */
+#define ROUND_TO_PAGES(x) (((size_t)(x) + OFFSET_MASK) & ~OFFSET_MASK)
+
+/** Calculate the floor of the log of a page count, used to pick a cache bucket. */
+#define CALC_LARGE_BUCKET(pages) ((unsigned int) (8*sizeof(size_t) - 1 - __builtin_clzll((pages))))
+
+/** The number of buckets in the large mapping cache, one per power-of-2 of pages. */
+#define LARGE_CACHE_BUCKETS 16
+
+/** The number of mappings that each large cache bucket can hold. */
+#define LARGE_CACHE_SLOTS 8
+
+/** The largest mapping that the large cache will hold onto. */
+#define LARGE_CACHE_MAX_LENGTH MB(32)
+
+/** The total number of bytes that the large cache may hold onto. */
+#define LARGE_CACHE_CAPACITY MB(64)
+
+/**
+ * The number of large allocations and deallocations after which a cached
+ * mapping is considered stale and is unmapped.
+ */
+#define LARGE_CACHE_MAX_AGE 1024
+
+/** How often, in large operations, the cache is swept for stale mappings. */
+#define LARGE_CACHE_SWEEP_PERIOD 64
+
+/** Lazily return unused pages to the kernel, if it supports doing so. */
+#if defined (MADV_FREE)
+#define RELEASE_ADVICE MADV_FREE
+#else
+#define RELEASE_ADVICE MADV_DONTNEED
+#endif
+
+/**
+ * Prefetch a block that is about to be handed out, and so written, unless
+ * compiled with `NO_PREFETCH` to measure what the prefetches are worth.
+ */
+#if defined (NO_PREFETCH)
+#define PREFETCH_BLOCK(bp)
+#else
+#define PREFETCH_BLOCK(bp) __builtin_prefetch((const void*)(bp), 1, 3)
+#endif
+
+/** The size class recorded for pages in the page pool. */
+#define POOL_CLASS 0
+
 /**
- * Given a pointer to a block, find the header at the top of the page that
- * contains the size class, and return that size.
+ * The number of page pool lists.  Each holds runs of exactly as many pages as
+ * its index, except for the last, which holds all longer runs.
  */
-#define GET_SIZE_CLASS(bp) (*(size_t*)((intptr_t)bp & ~OFFSET_MASK))
+#define POOL_LISTS 256
+
+/** Find the page pool list for runs of a given number of pages. */
+#define POOL_LIST(pages) ((pages) < POOL_LISTS - 1 ? (pages) : POOL_LISTS - 1)
+
+/** The number of bits in each word of the page pool's occupancy bitmap. */
+#define BITS_PER_POOL_WORD (8 * sizeof(uint64_t))
+
+/** The number of empty runs that a size class may always keep. */
+#define EMPTY_RUNS_KEPT 2
+
+/** The size class recorded for the pages of an object pool's runs. */
+#define OBJECT_POOL_CLASS (LARGE_CLASS + 1)
+
+/** The number of objects that an object pool's run should hold, if possible. */
+#define OBJECT_POOL_RUN_OBJECTS 64
 // ==============================================================================
 
 
 // ==============================================================================
 // GLOBALS
 
+/** The system's page size, and its log. */
+static size_t       page_size  = 0;
+static unsigned int page_shift = 0;
+
+/** The runtime settings, read from `SFALLOC_CONF` at initialization. */
+static alloc_conf_s conf = { .heap_size      = DEFAULT_HEAP_SIZE,
+			      .mmap_threshold = MAX_MEDIUM_SIZE,
+			      .thp            = ALLOC_THP_DEFAULT,
+			      .stats          = false,
+			      .fit            = ALLOC_FIT_BEST,
+			      .guard_rate     = GUARDPOOL_DEFAULT_RATE,
+			      .cacheline      = false,
+			      .color          = true,
+			      .numa_node      = ALLOC_NUMA_OFF,
+			      .persist_sync   = false,
+			      .persist_path   = "",
+			      .shared_name    = "" };
+
+/**
+ * The smallest size class handed out: `MIN_SIZE_CLASS`, or, if every block is
+ * to have whole cache lines, `CACHE_LINE_CLASS`.
+ */
+static unsigned int min_request_class = MIN_SIZE_CLASS;
+
 /** The address of the next available byte in the heap region. */
 static intptr_t free_addr  = 0;
 
@@ -96,8 +367,54 @@ static intptr_t start_addr = 0;
 /** The end of the heap. */
 static intptr_t end_addr   = 0;
 
-/** The array of free list heads, one per size class. */
-static header_s* free_lists[MAX_SIZE_CLASS + 1] = { NULL };
+/** The descriptors of the heap's pages, indexed by `PAGE_INDEX()`. */
+static page_s* page_map = NULL;
+
+/** The number of runs held by each size class... */
+static size_t class_runs[MAX_MEDIUM_CLASS + 1] = { 0 };
+
+/** ...and how many of those have no live blocks. */
+static size_t empty_runs[MAX_MEDIUM_CLASS + 1] = { 0 };
+
+/** The color to give the next run of each size class. */
+static unsigned int next_color[MAX_MEDIUM_CLASS + 1] = { 0 };
+
+/** The heads of the page pool lists, indexed by `POOL_LIST()`. */
+static page_s* page_pool[POOL_LISTS] = { NULL };
+
+/** A bitmap of which page pool lists are non-empty. */
+static uint64_t page_pool_occupied[POOL_LISTS / BITS_PER_POOL_WORD] = { 0 };
+
+/**
+ * The runs of each size class that have at least one free block, in the order
+ * in which they are to be drained.
+ */
+static page_s* partial_runs[MAX_MEDIUM_CLASS + 1] = { NULL };
+static page_s* partial_tails[MAX_MEDIUM_CLASS + 1] = { NULL };
+
+/** Recently freed large mappings, bucketed by the log of their page counts. */
+static large_entry_s large_cache[LARGE_CACHE_BUCKETS][LARGE_CACHE_SLOTS];
+
+/** The total number of bytes held in the large cache. */
+static size_t large_cache_bytes = 0;
+
+/** A clock that ticks once per large allocation or deallocation. */
+static size_t large_cache_clock = 0;
+
+/** The number of blocks of each class (large blocks included) ever allocated... */
+static size_t class_allocs[LARGE_CLASS + 1] = { 0 };
+
+/** ...and ever freed. */
+static size_t class_frees[LARGE_CLASS + 1] = { 0 };
+
+/** The total number of bytes ever requested. */
+static size_t requested_bytes = 0;
+
+/** The total length of all large mappings ever handed out... */
+static size_t large_allocated_bytes = 0;
+
+/** ...and of those still in use. */
+static size_t large_live_bytes = 0;
 // ==============================================================================
 
 
@@ -106,9 +423,9 @@ bool
 check () {
 
   bool error = false;
-  for (int i = MIN_SIZE_CLASS; i <= MAX_SIZE_CLASS; i += 1) {
-    if (free_lists[i] != NULL &&
-	(intptr_t)free_lists[i]->next < 0) {
+  for (int i = MIN_SIZE_CLASS; i <= MAX_MEDIUM_CLASS; i += 1) {
+    if (partial_runs[i] != NULL &&
+	partial_runs[i]->size_class != (unsigned int)i) {
       error = true;
     }
   }
@@ -130,7 +447,40 @@ void init () {
   if (start_addr == 0) {
 
     DEBUG("Trying to initialize");
-    
+
+    // Cache the page size, which the hot paths use to find page descriptors.
+    page_size  = sysconf(_SC_PAGESIZE);
+    page_shift = __builtin_ctzll(page_size);
+#if defined (SLAB_BITMAP)
+    if (PAGE_SIZE / CALC_CLASS_SIZE(MIN_SIZE_CLASS) > SLAB_BITMAP_WORDS * 64) {
+      ERROR("Page size too large for the slab bitmap", PAGE_SIZE);
+    }
+#endif
+
+    // Read the runtime settings.  The heap must be whole pages, and nothing
+    // larger than the largest medium class can come from it; a threshold of 0
+    // leaves only that to be mapped.
+    unsigned int accepted = (ALLOCCONF_HEAP_SIZE | ALLOCCONF_MMAP_THRESHOLD | ALLOCCONF_THP |
+			     ALLOCCONF_STATS | ALLOCCONF_CACHELINE | ALLOCCONF_COLOR);
+#if defined (GUARD_POOL)
+    accepted |= ALLOCCONF_GUARD_RATE;
+#endif
+#if defined (NUMA_AWARE)
+    accepted |= ALLOCCONF_NUMA;
+#endif
+    allocconf_load("SFALLOC_CONF", accepted, &conf);
+#if defined (GUARD_POOL)
+    guardpool_set_rate(conf.guard_rate);
+#endif
+    conf.heap_size = ROUND_TO_PAGES(conf.heap_size);
+    conf.numa_node = NUMABIND_RESOLVE(conf.numa_node);
+    if (conf.mmap_threshold == 0 || conf.mmap_threshold > MAX_MEDIUM_SIZE) {
+      conf.mmap_threshold = MAX_MEDIUM_SIZE;
+    }
+    if (conf.cacheline) {
+      min_request_class = CACHE_LINE_CLASS;
+    }
+
     // Allocate virtual address space in which the heap will reside. Make it
     // un-shared and not backed by any file (_anonymous_ space).  A failure to
     // map this space is fatal.
@@ -143,6 +493,24 @@ void init () {
     if (heap == MAP_FAILED) {
       ERROR("Could not mmap() heap region");
     }
+    NUMABIND_BIND(heap, HEAP_SIZE, conf.numa_node);
+    if (conf.thp != ALLOC_THP_DEFAULT) {
+      madvise(heap, HEAP_SIZE, conf.thp == ALLOC_THP_ON ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    }
+
+    // Allocate the page map alongside the heap.  Its pages are only touched
+    // as the heap grows into the corresponding heap pages.
+    void* map = mmap(NULL,
+		     (HEAP_SIZE / PAGE_SIZE) * sizeof(page_s),
+		     PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS,
+		     -1,
+		     0);
+    if (map == MAP_FAILED) {
+      ERROR("Could not mmap() page map");
+    }
+    NUMABIND_BIND(map, (HEAP_SIZE / PAGE_SIZE) * sizeof(page_s), conf.numa_node);
+    page_map = map;
 
     // Hold onto the boundaries of the heap as a whole.
     start_addr = (intptr_t)heap;
@@ -160,261 +528,1400 @@ void init () {
 
 // ==============================================================================
 /**
- * Allocate and return `size` bytes of heap space.  Specifically, search the
- * free list, choosing the _best fit_.  If no such block is available, expand
- * into the heap region via _pointer bumping_.
+ * Calculate the medium size class for a request between the largest small class
+ * and `MAX_MEDIUM_SIZE`.  Each power-of-2 range is split into
+ * `MEDIUM_CLASSES_PER_DOUBLING` equal steps.
  *
- * \param size The number of bytes to allocate.
- * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ * \param size The number of bytes requested.
+ * \return     The medium size class that holds `size` bytes.
  */
-void* malloc (size_t size) {
+static unsigned int calc_medium_class (size_t size) {
 
-  check();
-  init();
+  unsigned int log  = CALC_SIZE_CLASS(size);
+  unsigned int step = log - 1 - __builtin_ctz(MEDIUM_CLASSES_PER_DOUBLING);
+  size_t       base = (size_t)1 << (log - 1);
+  size_t       q    = (size - base + ((size_t)1 << step) - 1) >> step;
+  return MAX_SIZE_CLASS + (log - MAX_SIZE_CLASS - 1) * MEDIUM_CLASSES_PER_DOUBLING + q;
 
-  // Cannot allocate an empty block.
-  if (size == 0) {
-    return NULL;
+} // calc_medium_class ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Calculate the size of the blocks in a given small or medium size class.
+ *
+ * \param size_class The size class.
+ * \return           The size, in bytes, of each block of that class.
+ */
+static size_t calc_class_size (unsigned int size_class) {
+
+  if (size_class <= MAX_SIZE_CLASS) {
+    return CALC_CLASS_SIZE(size_class);
   }
 
-  // Grab the size class, and determine how to handle the request.
-  unsigned int size_class = CALC_SIZE_CLASS(size);
-  size_t       class_size = CALC_CLASS_SIZE(size_class);
-  DEBUG("malloc(): ", size, class_size, size_class);
-  if (size_class < MIN_SIZE_CLASS) {
+  unsigned int i    = size_class - MAX_SIZE_CLASS - 1;
+  unsigned int log  = MAX_SIZE_CLASS + 1 + i / MEDIUM_CLASSES_PER_DOUBLING;
+  unsigned int step = log - 1 - __builtin_ctz(MEDIUM_CLASSES_PER_DOUBLING);
+  size_t       q    = i % MEDIUM_CLASSES_PER_DOUBLING + 1;
+  return ((size_t)1 << (log - 1)) + (q << step);
+
+} // calc_class_size ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine how a request of a given size is to be served.
+ *
+ * \param size The number of bytes requested; must be non-zero.
+ * \return     The small or medium size class that holds `size` bytes, or
+ *              `LARGE_CLASS` if the request is to be mapped separately.
+ */
+static unsigned int calc_request_class (size_t size) {
+
+  // Small sizes are checked first, since the class of a 1 byte request is
+  // undefined.
+  if (size <= (size_t)CALC_CLASS_SIZE(min_request_class)) {
 
     // Bump it the request size to the minimum that we handle.
-    size_class = MIN_SIZE_CLASS;
-    class_size = CALC_CLASS_SIZE(size_class);
-    DEBUG("malloc(): Too small, bumped up size class", size_class);
+    return min_request_class;
 
-  } else if (size_class > MAX_SIZE_CLASS) {
+  } else if (size > MMAP_THRESHOLD) {
 
     // Handle this large allocation as an `mmap()`, separating it from the rest
     // of the heap.
-    DEBUG("malloc(): Too large, mapping separately");
-    void* new_block_ptr = mmap(NULL,                         // No particular location
-			       sizeof(size_t) + size,        // A header + the block
-			       PROT_READ | PROT_WRITE,
-			       MAP_PRIVATE | MAP_ANONYMOUS,  // Not backed by a file
-			       -1,                           // ditto
-			       0);                           // ditto
-    if (new_block_ptr == MAP_FAILED) {
-      DEBUG("Could not mmap() large allocation", size);
-      return NULL;
-    }
+    return LARGE_CLASS;
 
-    size_t* header = new_block_ptr;
-    *header = class_size;
-    intptr_t block_addr = (intptr_t)header + sizeof(size_t);
-    DEBUG("malloc(): Returning large block", block_addr);
-    check();
-    return (void*)block_addr;
+  } else if (size > CALC_CLASS_SIZE(MAX_SIZE_CLASS)) {
+
+    // Use the finer-grained medium classes.
+    return calc_medium_class(size);
 
   }
 
-  // Do we have a free block in the needed size class?
-  if (free_lists[size_class] == NULL) {
+  return CALC_SIZE_CLASS(size);
 
-    // No blocks of this size.  Is there more heap space?
-    if (free_addr >= end_addr) {
-      DEBUG("malloc(): Failing because heap is full");
-      return NULL;
-    }
+} // calc_request_class ()
+// ==============================================================================
 
-    // Allocate a new page, making sure it is aligned.
-    DEBUG("malloc(): Size class free list empty, replenishing");
-    assert((free_addr & OFFSET_MASK) == 0);
-    intptr_t new_page_addr = free_addr;
-    free_addr += PAGE_SIZE;
-
-    // Record the size class of the blocks in this page within the first block's
-    // space (which won't be used).
-    *(unsigned int*)new_page_addr = size_class;
-
-    // Loop through the remaining blocks of the page, chaining them together.
-    intptr_t current       = new_page_addr + class_size;
-    free_lists[size_class] = (header_s*)current;
-    while (current < free_addr) {
-
-      // Make this block point to the next one, unless we're at the last block,
-      // in which case mark the end of the list with a `NULL` next.
-      intptr_t next = current + class_size;
-      if (next < free_addr) {
-	((header_s*)current)->next = (header_s*)next;
-      } else {
-	((header_s*)current)->next = NULL;
-      }
 
-      // Move forward.
-      current = next;
-      
-    }
 
+// ==============================================================================
+/**
+ * Calculate the number of pages in each run of a size class.  Small classes use
+ * single pages, except for the colored ones, which use runs of
+ * `COLOR_RUN_BLOCKS` blocks; medium classes use runs of about
+ * `MEDIUM_RUN_BYTES`, or of one block if the blocks are larger than that.
+ *
+ * \param size_class The size class.
+ * \return           The number of pages in a run of that class.
+ */
+static size_t calc_run_pages (unsigned int size_class) {
+
+  size_t class_size = calc_class_size(size_class);
+  if (size_class < MIN_COLORED_CLASS) {
+    return 1;
+  } else if (size_class <= MAX_SIZE_CLASS) {
+    return ROUND_TO_PAGES(COLOR_RUN_BLOCKS * class_size) / PAGE_SIZE;
   }
 
-  // There is now at least one block of this size class, so allocate the first
-  // available.
-  assert(free_lists[size_class] != NULL);
-  void* new_block_ptr = (void*)free_lists[size_class];
-  check();
-  free_lists[size_class] = free_lists[size_class]->next;
-  
-  DEBUG("malloc() returning: ", (intptr_t)new_block_ptr);
-  check();
-  return new_block_ptr;
+  size_t blocks     = MEDIUM_RUN_BYTES / class_size;
+  if (blocks == 0) {
+    blocks = 1;
+  }
+  return ROUND_TO_PAGES(blocks * class_size) / PAGE_SIZE;
 
-} // malloc()
+} // calc_run_pages ()
 // ==============================================================================
 
 
 
 // ==============================================================================
 /**
- * Deallocate a given block on the heap.  Add the given block (if any) to the
- * free list.
+ * Calculate the number of blocks in each run of a size class.  A colored run
+ * long enough to spare one gives up a block if that is the only way to leave
+ * slack in which to color it.
  *
- * \param ptr A pointer to the block to be deallocated.
+ * \param size_class The size class.
+ * \param class_size The size of the blocks in that class.
+ * \return           The number of blocks in a run of that class.
  */
-void free (void* ptr) {
-
-  DEBUG("free(): ", (intptr_t)ptr);
-  check();
+static size_t calc_run_blocks (unsigned int size_class, size_t class_size) {
 
-  // This function is allowed to be passed a `NULL` pointer.  Do nothing.
-  if (ptr == NULL) {
-    DEBUG("free(): Doing nothing for NULL block");
-    return;
+  size_t run_bytes = calc_run_pages(size_class) * PAGE_SIZE;
+  size_t blocks    = run_bytes / class_size;
+  if (conf.color && size_class >= MIN_COLORED_CLASS && blocks >= COLOR_RUN_BLOCKS &&
+      run_bytes - blocks * class_size < ALLOC_CACHE_LINE) {
+    blocks -= 1;
   }
+  return blocks;
 
-  // Special case:  Is this a large block mmap'ed outside of the heap?
-  intptr_t addr = (intptr_t)ptr;
-  if ((addr < start_addr) || (end_addr < addr)) {
-
-    // Yes.  Walk back to its size header...
-    DEBUG("free(): Large block");
-    size_t* header = (size_t*)(addr - sizeof(size_t));
-    size_t  size   = *header;
-    assert(CALC_SIZE_CLASS(size) > MAX_SIZE_CLASS);
-    DEBUG("free(): Large block size = ", size);
+} // calc_run_blocks ()
+// ==============================================================================
 
-    // ...and unmap the region.
-    int result = munmap((void*)header, size + sizeof(size_t));
-    if (result == -1) {
-      ERROR("Could not unmap large block", (intptr_t)ptr);
-    }
 
-    check();
-    return;
-    
-  }
-  
-  // Grab the size of this block from the top of the page.
-  unsigned int size_class = GET_SIZE_CLASS(ptr);
-  assert((MIN_SIZE_CLASS <= size_class) && (size_class <= MAX_SIZE_CLASS));
-  DEBUG("free(): Returning to size class free list", size_class);
 
-  // Insert it at the head of its size class's free list.
-  header_s* header       = ptr;
-  header->next           = free_lists[size_class];
-  free_lists[size_class] = header;
+// ==============================================================================
+/**
+ * Given a pointer to a block in the heap, find the descriptor of its run.
+ *
+ * \param ptr The block.
+ * \return    The descriptor of the first page of the run containing `ptr`.
+ */
+static page_s* get_run (void* ptr) {
 
-  check();
+  page_s* page = &page_map[PAGE_INDEX(ptr)];
+  return page - page->run_offset;
 
-} // free()
+} // get_run ()
 // ==============================================================================
 
 
 
 // ==============================================================================
 /**
- * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
+ * Add a run to the page pool, recording its length at both of its ends so that
+ * its neighbors can find and merge with it.
  *
- * \param nmemb The number of elements in the new block.
- * \param size  The size, in bytes, of each of the `nmemb` elements.
- * \return      A pointer to the newly allocated and zeroed block, if successful;
- *              `NULL` if unsuccessful.
+ * \param run   The descriptor of the first page of the run.
+ * \param pages The number of pages in the run.
  */
-void* calloc (size_t nmemb, size_t size) {
+static void page_pool_insert (page_s* run, size_t pages) {
+
+  page_s* last     = run + pages - 1;
+  last->size_class = POOL_CLASS;
+  last->run_offset = pages - 1;
+  run->size_class  = POOL_CLASS;
+  run->run_offset  = 0;
+  run->run_pages   = pages;
+  run->live        = 0;
+
+  size_t list = POOL_LIST(pages);
+  run->prev   = NULL;
+  run->next   = page_pool[list];
+  if (run->next != NULL) {
+    run->next->prev = run;
+  }
+  page_pool[list] = run;
+  page_pool_occupied[list / BITS_PER_POOL_WORD] |= (uint64_t)1 << (list % BITS_PER_POOL_WORD);
 
-  // Allocate a block of the requested size.
-  size_t block_size    = nmemb * size;
-  void*  new_block_ptr = malloc(block_size);
+} // page_pool_insert ()
+// ==============================================================================
 
-  // If the allocation succeeded, clear the entire block.
-  if (new_block_ptr != NULL) {
-    memset(new_block_ptr, 0, block_size);
+
+
+// ==============================================================================
+/**
+ * Remove a run from its page pool list.
+ *
+ * \param run The descriptor of the first page of the run.
+ */
+static void page_pool_remove (page_s* run) {
+
+  size_t list = POOL_LIST(run->run_pages);
+  if (run->prev == NULL) {
+    page_pool[list] = run->next;
+  } else {
+    run->prev->next = run->next;
+  }
+  if (run->next != NULL) {
+    run->next->prev = run->prev;
   }
+  if (page_pool[list] == NULL) {
+    page_pool_occupied[list / BITS_PER_POOL_WORD] &= ~((uint64_t)1 << (list % BITS_PER_POOL_WORD));
+  }
+  run->next = NULL;
+  run->prev = NULL;
 
-  return new_block_ptr;
-  
-} // calloc ()
+} // page_pool_remove ()
 // ==============================================================================
 
 
 
 // ==============================================================================
 /**
- * Update the given block at `ptr` to take on the given `size`.  Here, if `size`
- * fits within the given block, then the block is returned unchanged.  If the
- * `size` is an increase for the block, then a new and larger block is
- * allocated, and the data from the old block is copied, the old block freed,
- * and the new block returned.
+ * Return a run to the page pool, handing its pages back to the kernel and
+ * merging it with any pooled neighbors.  A run that ends up at the top of the
+ * used heap is instead given back to the bump pointer.
  *
- * \param ptr  The block to be assigned a new size.
- * \param size The new size that the block should assume.
- * \return     A pointer to the resultant block, which may be `ptr` itself, or
- *             may be a newly allocated block.
+ * \param run   The descriptor of the first page of the run.
+ * \param pages The number of pages in the run.
  */
-void* realloc (void* ptr, size_t size) {
+static void page_pool_release (page_s* run, size_t pages) {
 
-  // Special case: If there is no original block, then just allocate the new one
-  // of the given size.
-  if (ptr == NULL) {
-    return malloc(size);
+  DEBUG("page_pool_release(): ", PAGE_ADDR(run), pages);
+  madvise((void*)PAGE_ADDR(run), pages * PAGE_SIZE, RELEASE_ADVICE);
+
+  // Merge with a pooled run just below...
+  if (run > page_map && run[-1].size_class == POOL_CLASS) {
+    page_s* below = run - 1 - run[-1].run_offset;
+    page_pool_remove(below);
+    pages += below->run_pages;
+    run    = below;
   }
 
-  // Special case: If the new size is 0, that's tantamount to freeing the block.
-  if (size == 0) {
-    free(ptr);
-    return NULL;
+  // ...and just above, if the heap extends that far.
+  page_s* above = run + pages;
+  if (above < &page_map[PAGE_INDEX(free_addr)] && above->size_class == POOL_CLASS) {
+    page_pool_remove(above);
+    pages += above->run_pages;
   }
 
-  // Special case:  Is this a large block that has been mmap'ed outside the heap?
-  intptr_t addr = (intptr_t)ptr;
-  if ((addr < start_addr) || (end_addr <= addr)) {
-
-    // Yes.  Grab its size from its header.  Calculate the size of the new block
-    // with the header, and then let mremap() handle the situation,
-    void*  old_ptr  = (void*)(addr - sizeof(size_t)); 
-    size_t old_size = *(size_t*)old_ptr;
-    size_t new_size = size + sizeof(size_t);
-    void*  new_ptr  = mremap(old_ptr, old_size, new_size, MREMAP_MAYMOVE);
-    if (new_ptr == MAP_FAILED) {
-      DEBUG("realloc(): mremap() of large block failed", old_size, new_size);
-      return NULL;
-    }
-    void* new_block_ptr = (void*)((intptr_t)new_ptr + sizeof(size_t));
-    return new_block_ptr;
-    
+  if (PAGE_ADDR(run + pages) == free_addr) {
+    free_addr = PAGE_ADDR(run);
+  } else {
+    page_pool_insert(run, pages);
   }
-  
-  // Get the current block size class.
-  unsigned int size_class = GET_SIZE_CLASS(ptr);
 
-  // If the new size fits in the current size, we're done.
-  if (CALC_SIZE_CLASS(size) <= size_class) {
+} // page_pool_release ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a run of a given length from the page pool, splitting a longer run if
+ * there is none of exactly that length.
+ *
+ * \param pages The number of pages needed.
+ * \return      The address of the run, if one was available; 0 otherwise.
+ */
+static intptr_t page_pool_take (size_t pages) {
+
+  // Find the first non-empty list that could hold a long enough run.
+  page_s* run = NULL;
+  for (size_t list = POOL_LIST(pages); list < POOL_LISTS && run == NULL; list += 1) {
+    uint64_t word = page_pool_occupied[list / BITS_PER_POOL_WORD] >> (list % BITS_PER_POOL_WORD);
+    if (word == 0) {
+      list = (list / BITS_PER_POOL_WORD + 1) * BITS_PER_POOL_WORD - 1;
+      continue;
+    }
+    list += __builtin_ctzll(word);
+
+    // Runs in the last list vary in length, so search it for a first fit.
+    run = page_pool[list];
+    while (run != NULL && run->run_pages < pages) {
+      run = run->next;
+    }
+  }
+  if (run == NULL) {
+    return 0;
+  }
+
+  // Keep what we need, and put back the rest.  (Its pages were already
+  // released.)
+  page_pool_remove(run);
+  if (run->run_pages > pages) {
+    page_pool_insert(run + pages, run->run_pages - pages);
+  }
+  DEBUG("page_pool_take(): ", PAGE_ADDR(run), pages);
+  return PAGE_ADDR(run);
+
+} // page_pool_take ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Carve a run of pages, from the page pool if possible, or else from the heap
+ * region, and tag each of its pages with a size class.
+ *
+ * \param size_class The size class to record in the run's page descriptors.
+ * \param run_pages  The number of pages in the run.
+ * \return           The descriptor of the run, if successful; `NULL` if the
+ *                    heap is full.
+ */
+static page_s* new_pages (unsigned int size_class, size_t run_pages) {
+
+  size_t   run_bytes     = run_pages * PAGE_SIZE;
+  intptr_t new_page_addr = page_pool_take(run_pages);
+  if (new_page_addr == 0) {
+    if (free_addr + (intptr_t)run_bytes > end_addr) {
+      DEBUG("new_pages(): Failing because heap is full");
+      return NULL;
+    }
+
+    // Allocate a new run, making sure it is aligned.
+    assert((free_addr & OFFSET_MASK) == 0);
+    new_page_addr = free_addr;
+    free_addr    += run_bytes;
+  }
+
+  // Record the size class of the blocks in each page of the run.
+  page_s* run = &page_map[PAGE_INDEX(new_page_addr)];
+  for (size_t i = 0; i < run_pages; i += 1) {
+    run[i].size_class = size_class;
+    run[i].run_offset = i;
+  }
+  run->run_pages = run_pages;
+  run->live      = 0;
+  run->color     = 0;
+  return run;
+
+} // new_pages ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Carve a new run for a size class.  The run starts with no live blocks.
+ *
+ * \param size_class The size class of the blocks in the new run.
+ * \return           The descriptor of the run, if successful; `NULL` if the
+ *                    heap is full.
+ */
+static page_s* new_run (unsigned int size_class) {
+
+  page_s* run = new_pages(size_class, calc_run_pages(size_class));
+  if (run == NULL) {
+    return NULL;
+  }
+  class_runs[size_class] += 1;
+  empty_runs[size_class] += 1;
+  return run;
+
+} // new_run ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Append a run to the back of its size class's list of partial runs, so that
+ * the run currently being drained stays at the front.
+ *
+ * \param size_class The size class of the run.
+ * \param run        The descriptor of the run.
+ */
+static void partial_append (unsigned int size_class, page_s* run) {
+
+  run->next = NULL;
+  run->prev = partial_tails[size_class];
+  if (run->prev == NULL) {
+    partial_runs[size_class] = run;
+  } else {
+    run->prev->next = run;
+  }
+  partial_tails[size_class] = run;
+
+} // partial_append ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Remove a run from its size class's list of partial runs.
+ *
+ * \param size_class The size class of the run.
+ * \param run        The descriptor of the run.
+ */
+static void partial_remove (unsigned int size_class, page_s* run) {
+
+  if (run->prev == NULL) {
+    partial_runs[size_class] = run->next;
+  } else {
+    run->prev->next = run->next;
+  }
+  if (run->next == NULL) {
+    partial_tails[size_class] = run->prev;
+  } else {
+    run->next->prev = run->prev;
+  }
+  run->next = NULL;
+  run->prev = NULL;
+
+} // partial_remove ()
+// ==============================================================================
+
+
+
+#if defined (SLAB_BITMAP)
+// ==============================================================================
+/**
+ * Find the first free slot in a run's bitmap.  With AVX2, the bitmap is tested
+ * 256 bits at a time, and only the word holding the first free slot is read
+ * individually.
+ *
+ * \param run The descriptor of the run.
+ * \return    The index of the first free slot, or -1 if the run is full.
+ */
+static int find_free_slot (page_s* run) {
+
+#if defined (__AVX2__)
+  for (int word = 0; word < SLAB_BITMAP_WORDS; word += 4) {
+    __m256i bits  = _mm256_loadu_si256((__m256i*)&run->free_slots[word]);
+    __m256i zeros = _mm256_cmpeq_epi64(bits, _mm256_setzero_si256());
+    int     mask  = ~_mm256_movemask_pd(_mm256_castsi256_pd(zeros)) & 0xf;
+    if (mask != 0) {
+      word += __builtin_ctz(mask);
+      return word * 64 + __builtin_ctzll(run->free_slots[word]);
+    }
+  }
+#else
+  for (int word = 0; word < SLAB_BITMAP_WORDS; word += 1) {
+    if (run->free_slots[word] != 0) {
+      return word * 64 + __builtin_ctzll(run->free_slots[word]);
+    }
+  }
+#endif
+
+  return -1;
+
+} // find_free_slot ()
+// ==============================================================================
+#endif /* SLAB_BITMAP */
+
+
+
+// ==============================================================================
+/**
+ * Get a new run for a size class, either from the page pool or from more heap
+ * space, with every block free, and append it to the class's partial runs.
+ *
+ * \param size_class The size class.
+ * \param class_size The size of the blocks in that class.
+ * \return           The descriptor of the run, if successful; `NULL` if the
+ *                    heap is full.
+ */
+static page_s* run_replenish (unsigned int size_class, size_t class_size) {
+
+  DEBUG("run_replenish(): No partial runs, replenishing", size_class);
+  LATENCY_PATH(LATENCY_REFILL);
+  page_s* run = new_run(size_class);
+  if (run == NULL) {
+    return NULL;
+  }
+  size_t blocks = calc_run_blocks(size_class, class_size);
+
+  // Color the run, rotating through the offsets that fit in its slack one
+  // cache line at a time.
+  if (conf.color && size_class >= MIN_COLORED_CLASS) {
+    size_t slack = run->run_pages * PAGE_SIZE - blocks * class_size;
+    if (next_color[size_class] > slack) {
+      next_color[size_class] = 0;
+    }
+    run->color              = next_color[size_class];
+    next_color[size_class] += ALLOC_CACHE_LINE;
+  }
+
+#if defined (SLAB_BITMAP)
+  run->slots = blocks;
+  for (unsigned int word = 0; word < SLAB_BITMAP_WORDS; word += 1) {
+    unsigned int first = word * 64;
+    if (run->slots >= first + 64) {
+      run->free_slots[word] = ~(uint64_t)0;
+    } else if (run->slots > first) {
+      run->free_slots[word] = ((uint64_t)1 << (run->slots - first)) - 1;
+    } else {
+      run->free_slots[word] = 0;
+    }
+  }
+#else
+  // Loop through the blocks of the run that fit entirely, chaining them
+  // together.
+  intptr_t current = PAGE_ADDR(run) + run->color;
+  intptr_t run_end = current + blocks * class_size;
+  run->free_list   = (header_s*)current;
+  while (current < run_end) {
+
+    // Make this block point to the next one, unless we're at the last block,
+    // in which case mark the end of the list with a `NULL` next.
+    intptr_t next = current + class_size;
+    if (next < run_end) {
+      ((header_s*)current)->next = (header_s*)next;
+    } else {
+      ((header_s*)current)->next = NULL;
+    }
+
+    // Move forward.
+    current = next;
+      
+  }
+#endif /* SLAB_BITMAP */
+
+  partial_append(size_class, run);
+  return run;
+
+} // run_replenish ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block of a size class from the first of its partial runs, carving
+ * a new run if there is none.  That run is used until it is full, and only then
+ * does allocation move on to the next one.
+ *
+ * \param size_class The size class.
+ * \param class_size The size of the blocks in that class.
+ * \return           A pointer to the allocated block, if successful; `NULL` if
+ *                    the heap is full.
+ */
+static void* run_alloc (unsigned int size_class, size_t class_size) {
+
+  page_s* run = partial_runs[size_class];
+  if (run == NULL) {
+    run = run_replenish(size_class, class_size);
+    if (run == NULL) {
+      return NULL;
+    }
+  }
+
+  // Take a free block from the run.
+#if defined (SLAB_BITMAP)
+  int slot = find_free_slot(run);
+  assert(slot >= 0);
+  run->free_slots[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+  void* block_ptr = (void*)(PAGE_ADDR(run) + run->color + (intptr_t)slot * class_size);
+  bool  full      = (run->live + 1 == run->slots);
+  PREFETCH_BLOCK(block_ptr); // nothing here touches it, but the caller will
+#else
+  // Popping a block reads its link, so prefetch the new head now, to be warm
+  // by the next pop, rather than chase the pointer through a cold line then.
+  assert(run->free_list != NULL);
+  void* block_ptr = (void*)run->free_list;
+  run->free_list  = run->free_list->next;
+  bool  full      = (run->free_list == NULL);
+  PREFETCH_BLOCK(run->free_list);
+#endif
+
+  // Count the block as live, retiring the run from the partial list if that
+  // filled it.
+  if (run->live == 0) {
+    empty_runs[size_class] -= 1;
+  }
+  run->live                += 1;
+  class_allocs[size_class] += 1;
+  if (full) {
+    partial_remove(size_class, run);
+  }
+
+  return block_ptr;
+
+} // run_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate up to `n` blocks of a size class, taking as many as possible from
+ * each partial run in turn.  In list mode, each run gives up a whole chain of
+ * its free list at once; in bitmap mode, a whole word of its bitmap.
+ *
+ * \param size_class The size class.
+ * \param class_size The size of the blocks in that class.
+ * \param n          The number of blocks wanted.
+ * \param ptrs       Where to store pointers to the allocated blocks.
+ * \return           The number of blocks allocated.
+ */
+static size_t run_alloc_batch (unsigned int size_class, size_t class_size,
+			       size_t n, void** ptrs) {
+
+  size_t filled = 0;
+  while (filled < n) {
+
+    page_s* run = partial_runs[size_class];
+    if (run == NULL) {
+      run = run_replenish(size_class, class_size);
+      if (run == NULL) {
+	break;
+      }
+    }
+
+    size_t taken = 0;
+#if defined (SLAB_BITMAP)
+    intptr_t base = PAGE_ADDR(run) + run->color;
+    for (unsigned int word = 0; word < SLAB_BITMAP_WORDS && filled + taken < n; word += 1) {
+      uint64_t bits = run->free_slots[word];
+      while (bits != 0 && filled + taken < n) {
+	intptr_t slot  = word * 64 + __builtin_ctzll(bits);
+	bits          &= bits - 1;
+	ptrs[filled + taken] = (void*)(base + slot * (intptr_t)class_size);
+	taken += 1;
+      }
+      run->free_slots[word] = bits;
+    }
+    bool full = (run->live + taken == run->slots);
+#else
+    // Walk as far down the run's free list as needed, then cut it there.
+    header_s* block = run->free_list;
+    while (block != NULL && filled + taken < n) {
+      ptrs[filled + taken] = block;
+      taken += 1;
+      block  = block->next;
+    }
+    run->free_list = block;
+    bool full      = (block == NULL);
+    PREFETCH_BLOCK(block);
+#endif
+
+    if (run->live == 0) {
+      empty_runs[size_class] -= 1;
+    }
+    run->live += taken;
+    filled    += taken;
+    if (full) {
+      partial_remove(size_class, run);
+    }
+
+  }
+
+  class_allocs[size_class] += filled;
+  return filled;
+
+} // run_alloc_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Determine whether a run has no free blocks, and so is not on its class's
+ * list of partial runs.
+ *
+ * \param run The descriptor of the run.
+ * \return    `true` if the run is full.
+ */
+static bool run_is_full (page_s* run) {
+
+#if defined (SLAB_BITMAP)
+  return run->live == run->slots;
+#else
+  return run->free_list == NULL;
+#endif
+
+} // run_is_full ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return a block to its run's free blocks, without updating the run's counts.
+ *
+ * \param run        The descriptor of the block's run.
+ * \param size_class The size class of the block.
+ * \param ptr        The block.
+ */
+static void run_push (page_s* run, unsigned int size_class, void* ptr) {
+
+#if defined (SLAB_BITMAP)
+  intptr_t offset = (intptr_t)ptr - PAGE_ADDR(run) - run->color;
+  size_t   slot   = (size_class <= MAX_SIZE_CLASS ?
+		     (size_t)offset >> size_class :
+		     (size_t)offset / calc_class_size(size_class));
+  uint64_t bit    = (uint64_t)1 << (slot % 64);
+  if (run->free_slots[slot / 64] & bit) {
+    ERROR("Double-free: ", (intptr_t)ptr);
+  }
+  run->free_slots[slot / 64] |= bit;
+#else
+  // Insert it at the head of its run's free list; the class is needed only to
+  // find the block's slot.
+  (void)size_class;
+  header_s* header = ptr;
+  header->next     = run->free_list;
+  run->free_list   = header;
+#endif
+
+} // run_push ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Account for blocks returned to a run.  A run that was full rejoins the back
+ * of its class's partial list; a run that becomes empty is returned to the page
+ * pool if the class already holds enough empty runs.
+ *
+ * \param run        The descriptor of the run.
+ * \param size_class The size class of the run.
+ * \param freed      The number of blocks returned by `run_push()`.
+ * \param was_full   Whether the run was full before those blocks were returned.
+ */
+static void run_settle (page_s* run, unsigned int size_class, size_t freed, bool was_full) {
+
+  if (was_full) {
+    partial_append(size_class, run);
+  }
+  assert(run->live >= freed);
+  run->live               -= freed;
+  class_frees[size_class] += freed;
+  if (run->live == 0) {
+    empty_runs[size_class] += 1;
+    if (empty_runs[size_class] > EMPTY_RUNS_KEPT + class_runs[size_class] / 8) {
+      partial_remove(size_class, run);
+      class_runs[size_class] -= 1;
+      empty_runs[size_class] -= 1;
+      page_pool_release(run, run->run_pages);
+    }
+  }
+
+} // run_settle ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return a block to its run.
+ *
+ * \param ptr        The block.
+ * \param size_class The size class of the block.
+ */
+static void run_free (void* ptr, unsigned int size_class) {
+
+  page_s* run      = get_run(ptr);
+  bool    was_full = run_is_full(run);
+  run_push(run, size_class, ptr);
+  run_settle(run, size_class, 1, was_full);
+
+} // run_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Advance the large-operation clock, and every so often unmap any cached
+ * mappings that have not been reused for `LARGE_CACHE_MAX_AGE` ticks.
+ */
+static void large_cache_tick () {
+
+  large_cache_clock += 1;
+  if (large_cache_clock % LARGE_CACHE_SWEEP_PERIOD != 0) {
+    return;
+  }
+
+  for (int bucket = 0; bucket < LARGE_CACHE_BUCKETS; bucket += 1) {
+    for (int slot = 0; slot < LARGE_CACHE_SLOTS; slot += 1) {
+      large_entry_s* entry = &large_cache[bucket][slot];
+      if (entry->addr != 0 &&
+	  large_cache_clock - entry->stamp > LARGE_CACHE_MAX_AGE) {
+	DEBUG("large_cache_tick(): Unmapping stale mapping", entry->addr, entry->length);
+	if (munmap((void*)entry->addr, entry->length) == -1) {
+	  ERROR("Could not unmap cached large mapping", entry->addr);
+	}
+	large_cache_bytes -= entry->length;
+	entry->addr        = 0;
+      }
+    }
+  }
+
+} // large_cache_tick ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Remove and return a cached mapping of at least `length` bytes, if there is
+ * one.  Only the bucket for `length` is searched, so that a reused mapping is
+ * never more than twice the size needed.
+ *
+ * \param length     The number of bytes needed, a multiple of the page size.
+ * \param length_ptr Where to store the actual length of the returned mapping.
+ * \return           The base of the mapping, if found; `NULL` otherwise.
+ */
+static void* large_cache_take (size_t length, size_t* length_ptr) {
+
+  large_cache_tick();
+  if (length > LARGE_CACHE_MAX_LENGTH) {
+    return NULL;
+  }
+
+  // Choose the smallest mapping in the bucket that is large enough.
+  unsigned int   bucket = CALC_LARGE_BUCKET(length / PAGE_SIZE);
+  large_entry_s* best   = NULL;
+  for (int slot = 0; slot < LARGE_CACHE_SLOTS; slot += 1) {
+    large_entry_s* entry = &large_cache[bucket][slot];
+    if (entry->addr != 0 && length <= entry->length &&
+	(best == NULL || entry->length < best->length)) {
+      best = entry;
+    }
+  }
+  if (best == NULL) {
+    return NULL;
+  }
+
+  DEBUG("large_cache_take(): Reusing mapping", best->addr, best->length);
+  void* region       = (void*)best->addr;
+  *length_ptr        = best->length;
+  large_cache_bytes -= best->length;
+  best->addr         = 0;
+  return region;
+
+} // large_cache_take ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Hold onto a freed large mapping for later reuse, letting the kernel reclaim
+ * its pages lazily in the meantime.  If its bucket is full, the oldest mapping
+ * in that bucket is unmapped to make room.
+ *
+ * \param region The base of the mapping.
+ * \param length The length of the mapping, a multiple of the page size.
+ * \return       `true` if the mapping was cached; `false` if the caller must
+ *                unmap it.
+ */
+static bool large_cache_put (void* region, size_t length) {
+
+  large_cache_tick();
+  if (length > LARGE_CACHE_MAX_LENGTH ||
+      large_cache_bytes + length > LARGE_CACHE_CAPACITY) {
+    return false;
+  }
+
+  // Find an empty slot, or else the oldest entry to evict.
+  unsigned int   bucket = CALC_LARGE_BUCKET(length / PAGE_SIZE);
+  large_entry_s* victim = &large_cache[bucket][0];
+  for (int slot = 0; slot < LARGE_CACHE_SLOTS; slot += 1) {
+    large_entry_s* entry = &large_cache[bucket][slot];
+    if (entry->addr == 0) {
+      victim = entry;
+      break;
+    }
+    if (entry->stamp < victim->stamp) {
+      victim = entry;
+    }
+  }
+  if (victim->addr != 0) {
+    DEBUG("large_cache_put(): Evicting mapping", victim->addr, victim->length);
+    if (munmap((void*)victim->addr, victim->length) == -1) {
+      ERROR("Could not unmap cached large mapping", victim->addr);
+    }
+    large_cache_bytes -= victim->length;
+  }
+
+  // The contents are dead, so the kernel may take the pages back whenever it
+  // likes; if it does, they will simply come back zeroed.
+  madvise(region, length, RELEASE_ADVICE);
+  victim->addr       = (intptr_t)region;
+  victim->length     = length;
+  victim->stamp      = large_cache_clock;
+  large_cache_bytes += length;
+  return true;
+  
+} // large_cache_put ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a large block in its own mapping, preferring a cached mapping over a
+ * fresh `mmap()`.  The mapping begins with a header that records its length.
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the allocated block, if successful; `NULL` if
+ *              unsuccessful.
+ */
+static void* large_alloc (size_t size) {
+
+  // Round the header and the block up to whole pages.
+  size_t length = ROUND_TO_PAGES(sizeof(size_t) + size);
+  if (length < size) {
+    return NULL;
+  }
+
+  LATENCY_PATH(LATENCY_LARGE_CACHE);
+  void* region = large_cache_take(length, &length);
+  if (region == NULL) {
+    LATENCY_PATH(LATENCY_MMAP);
+    region = mmap(NULL,                         // No particular location
+		  length,
+		  PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS,  // Not backed by a file
+		  -1,                           // ditto
+		  0);                           // ditto
+    if (region == MAP_FAILED) {
+      DEBUG("Could not mmap() large allocation", size);
+      return NULL;
+    }
+    NUMABIND_BIND(region, length, conf.numa_node);
+  }
+
+  class_allocs[LARGE_CLASS] += 1;
+  large_allocated_bytes     += length;
+  large_live_bytes          += length;
+
+  size_t* header = region;
+  *header = length;
+  return (void*)((intptr_t)header + sizeof(size_t));
+
+} // large_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Free a large block, either caching its mapping or unmapping it.
+ *
+ * \param ptr The block.
+ */
+static void large_free (void* ptr) {
+
+  // Walk back to its length header.
+  size_t* header = (size_t*)((intptr_t)ptr - sizeof(size_t));
+  size_t  length = *header;
+  assert((length & OFFSET_MASK) == 0);
+  DEBUG("large_free(): Large block length = ", length);
+  class_frees[LARGE_CLASS] += 1;
+  large_live_bytes         -= length;
+
+  if (!large_cache_put((void*)header, length)) {
+    int result = munmap((void*)header, length);
+    if (result == -1) {
+      ERROR("Could not unmap large block", (intptr_t)ptr);
+    }
+  }
+
+} // large_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate and return `size` bytes of heap space.  Specifically, search the
+ * free list, choosing the _best fit_.  If no such block is available, expand
+ * into the heap region via _pointer bumping_.
+ *
+ * \param size The number of bytes to allocate.
+ * \return A pointer to the allocated block, if successful; `NULL` if unsuccessful.
+ */
+void* malloc (size_t size) {
+
+  check();
+  init();
+
+  // Cannot allocate an empty block.
+  if (size == 0) {
+    return NULL;
+  }
+
+  // Maybe take this one as a guarded sample instead.
+  void* guarded_ptr = GUARDPOOL_MALLOC(size);
+  if (guarded_ptr != NULL) {
+    DEBUG("malloc(): Returning guarded block", (intptr_t)guarded_ptr);
+    HEAPPROF_MALLOC(guarded_ptr, size);
+    ALLOCTRACE(ALLOCTRACE_MALLOC, guarded_ptr, size, NULL);
+    return guarded_ptr;
+  }
+
+  LATENCY_BEGIN(LATENCY_FREE_LIST_HIT);
+
+  // Grab the size class, and determine how to handle the request.
+  requested_bytes        += size;
+  unsigned int size_class = calc_request_class(size);
+  if (size_class == LARGE_CLASS) {
+
+    // Handle this large allocation as an `mmap()`, separating it from the rest
+    // of the heap.
+    DEBUG("malloc(): Too large, mapping separately");
+    void* block_ptr = large_alloc(size);
+    DEBUG("malloc(): Returning large block", (intptr_t)block_ptr);
+    HEAPPROF_MALLOC(block_ptr, size);
+    ALLOCTRACE(ALLOCTRACE_MALLOC, block_ptr, size, NULL);
+    LATENCY_END();
+    check();
+    return block_ptr;
+
+  }
+  size_t class_size = calc_class_size(size_class);
+  DEBUG("malloc(): ", size, class_size, size_class);
+
+  // Take a free block from the first of the class's partial runs.
+  void* new_block_ptr = run_alloc(size_class, class_size);
+  if (new_block_ptr == NULL) {
+    DEBUG("malloc(): Failing because heap is full");
+    LATENCY_END();
+    return NULL;
+  }
+  
+  DEBUG("malloc() returning: ", (intptr_t)new_block_ptr);
+  HEAPPROF_MALLOC(new_block_ptr, size);
+  ALLOCTRACE(ALLOCTRACE_MALLOC, new_block_ptr, size, NULL);
+  LATENCY_END();
+  check();
+  return new_block_ptr;
+
+} // malloc()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a given block on the heap.  Add the given block (if any) to the
+ * free list.
+ *
+ * \param ptr A pointer to the block to be deallocated.
+ */
+void free (void* ptr) {
+
+  DEBUG("free(): ", (intptr_t)ptr);
+  check();
+
+  // This function is allowed to be passed a `NULL` pointer.  Do nothing.
+  if (ptr == NULL) {
+    DEBUG("free(): Doing nothing for NULL block");
+    return;
+  }
+  LATENCY_BEGIN(LATENCY_FREE);
+  HEAPPROF_FREE(ptr);
+  ALLOCTRACE(ALLOCTRACE_FREE, ptr, 0, NULL);
+
+  // Special case:  Is this a guarded sample?  If so, just close its slot.
+  if (GUARDPOOL_OWNS(ptr)) {
+    DEBUG("free(): Guarded block");
+    GUARDPOOL_FREE(ptr);
+    LATENCY_END();
+    return;
+  }
+
+  // Special case:  Is this a large block mmap'ed outside of the heap?
+  intptr_t addr = (intptr_t)ptr;
+  if ((addr < start_addr) || (end_addr < addr)) {
+
+    // Yes.  Either cache its mapping or unmap it.
+    DEBUG("free(): Large block");
+    large_free(ptr);
+    LATENCY_END();
+    check();
+    return;
+    
+  }
+  
+  // Grab the size of this block from the top of the page.
+  unsigned int size_class = GET_SIZE_CLASS(ptr);
+  assert((MIN_SIZE_CLASS <= size_class) && (size_class <= MAX_MEDIUM_CLASS));
+  DEBUG("free(): Returning to its run", size_class);
+
+  run_free(ptr, size_class);
+  LATENCY_END();
+
+  check();
+
+} // free()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a block whose size is known.  A size above the mmap threshold
+ * marks a large block, so the heap range check is skipped; any other block
+ * still needs its run's descriptor to be returned to its run, and the class
+ * recorded there must agree with the one computed from `size`.
+ *
+ * \param ptr  The block to deallocate; may be `NULL`.
+ * \param size The size originally requested for the block.
+ */
+void free_sized (void* ptr, size_t size) {
+
+  DEBUG("free_sized(): ", (intptr_t)ptr, size);
+
+  if (ptr == NULL) {
+    return;
+  }
+  HEAPPROF_FREE(ptr);
+  ALLOCTRACE(ALLOCTRACE_FREE, ptr, 0, NULL);
+  if (GUARDPOOL_OWNS(ptr)) {
+    GUARDPOOL_FREE(ptr);
+    return;
+  }
+
+  unsigned int size_class = calc_request_class(size);
+
+#if defined (DEBUG_ALLOC)
+  // Cross-check the given size against where the block lies.
+  intptr_t addr  = (intptr_t)ptr;
+  bool     large = (addr < start_addr) || (end_addr <= addr);
+  if (large != (size_class == LARGE_CLASS)) {
+    ERROR("free_sized(): Size does not match block", addr, size);
+  }
+#endif
+
+  if (size_class == LARGE_CLASS) {
+    large_free(ptr);
+    return;
+  }
+
+  // The run's descriptor is read to return the block anyway, so check the given
+  // size against its class in every build, lest the block land in another run.
+  page_s* run = get_run(ptr);
+  if (run->size_class != size_class) {
+    ERROR("free_sized(): Size does not match block", (intptr_t)ptr, size, run->size_class);
+  }
+  run_free(ptr, size_class);
+
+} // free_sized ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate a block whose alignment and size are known.  Blocks are never
+ * over-aligned, so this is the same as `free_sized()`.
+ *
+ * \param ptr       The block to deallocate; may be `NULL`.
+ * \param alignment The alignment originally requested for the block.
+ * \param size      The size originally requested for the block.
+ */
+void free_aligned_sized (void* ptr, size_t alignment, size_t size) {
+
+  assert(alignment <= CALC_CLASS_SIZE(MIN_SIZE_CLASS));
+  free_sized(ptr, size);
+
+} // free_aligned_sized ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate `n` blocks of `size` bytes each.  The size class is determined once,
+ * and the blocks are taken a run at a time.
+ *
+ * \param size The number of bytes in each block.
+ * \param n    The number of blocks to allocate.
+ * \param ptrs Where to store pointers to the new blocks.
+ * \return     The number of blocks allocated.
+ */
+size_t malloc_batch (size_t size, size_t n, void** ptrs) {
+
+  init();
+
+  // Cannot allocate empty blocks.
+  if (size == 0) {
+    return 0;
+  }
+
+  unsigned int size_class = calc_request_class(size);
+  size_t       filled     = 0;
+  DEBUG("malloc_batch(): ", size, n, size_class);
+  if (size_class == LARGE_CLASS) {
+
+    // Large blocks each need their own mapping anyway.
+    while (filled < n) {
+      ptrs[filled] = large_alloc(size);
+      if (ptrs[filled] == NULL) {
+	break;
+      }
+      filled += 1;
+    }
+
+  } else {
+    filled = run_alloc_batch(size_class, calc_class_size(size_class), n, ptrs);
+  }
+
+  requested_bytes += filled * size;
+#if defined (HEAP_PROFILE) || defined (ALLOC_TRACE)
+  for (size_t i = 0; i < filled; i += 1) {
+    HEAPPROF_MALLOC(ptrs[i], size);
+    ALLOCTRACE(ALLOCTRACE_MALLOC, ptrs[i], size, NULL);
+  }
+#endif
+  return filled;
+
+} // malloc_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Deallocate `n` blocks at once.  Consecutive blocks from the same run are
+ * returned to it together, so that the run's counts are updated once per group
+ * rather than once per block.
+ *
+ * \param ptrs The blocks to deallocate; `NULL` entries are skipped.
+ * \param n    The number of entries in `ptrs`.
+ */
+void free_batch (void** ptrs, size_t n) {
+
+  DEBUG("free_batch(): ", n);
+
+  page_s* run      = NULL;
+  size_t  freed    = 0;
+  bool    was_full = false;
+  for (size_t i = 0; i < n; i += 1) {
+
+    void*    ptr  = ptrs[i];
+    intptr_t addr = (intptr_t)ptr;
+    if (ptr == NULL) {
+      continue;
+    }
+    HEAPPROF_FREE(ptr);
+    ALLOCTRACE(ALLOCTRACE_FREE, ptr, 0, NULL);
+    if (GUARDPOOL_OWNS(ptr)) {
+      GUARDPOOL_FREE(ptr);
+      continue;
+    }
+    if ((addr < start_addr) || (end_addr <= addr)) {
+      large_free(ptr);
+      continue;
+    }
+
+    // Settle the previous group when the run changes.
+    page_s* block_run = get_run(ptr);
+    if (block_run != run) {
+      if (run != NULL) {
+	run_settle(run, run->size_class, freed, was_full);
+      }
+      run      = block_run;
+      freed    = 0;
+      was_full = run_is_full(run);
+    }
+    run_push(run, run->size_class, ptr);
+    freed += 1;
+
+  }
+
+  if (run != NULL) {
+    run_settle(run, run->size_class, freed, was_full);
+  }
+
+} // free_batch ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Allocate a block of `nmemb * size` bytes on the heap, zeroing its contents.
+ *
+ * \param nmemb The number of elements in the new block.
+ * \param size  The size, in bytes, of each of the `nmemb` elements.
+ * \return      A pointer to the newly allocated and zeroed block, if successful;
+ *              `NULL` if unsuccessful.
+ */
+void* calloc (size_t nmemb, size_t size) {
+
+  // Allocate a block of the requested size.
+  size_t block_size    = nmemb * size;
+  ALLOCTRACE_NEST();
+  void*  new_block_ptr = malloc(block_size);
+  ALLOCTRACE_UNNEST();
+
+  // If the allocation succeeded, clear the entire block.
+  if (new_block_ptr != NULL) {
+    memset(new_block_ptr, 0, block_size);
+    ALLOCTRACE(ALLOCTRACE_CALLOC, new_block_ptr, block_size, NULL);
+  }
+
+  return new_block_ptr;
+  
+} // calloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Update the given block at `ptr` to take on the given `size`.  Here, if `size`
+ * falls in the block's own size class, then the block is returned unchanged,
+ * so that `free_sized()` with the new size finds the same class.  Otherwise, a
+ * new block is allocated, the data from the old block is copied, the old block
+ * freed, and the new block returned.
+ *
+ * \param ptr  The block to be assigned a new size.
+ * \param size The new size that the block should assume.
+ * \return     A pointer to the resultant block, which may be `ptr` itself, or
+ *             may be a newly allocated block.
+ */
+void* realloc (void* ptr, size_t size) {
+
+  // Special case: If there is no original block, then just allocate the new one
+  // of the given size.
+  if (ptr == NULL) {
+    return malloc(size);
+  }
+
+  // Special case: If the new size is 0, that's tantamount to freeing the block.
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  // Special case:  Is this a large block that has been mmap'ed outside the heap,
+  // and is the new size large, too?
+  intptr_t     addr      = (intptr_t)ptr;
+  bool         large     = !GUARDPOOL_OWNS(ptr) && ((addr < start_addr) || (end_addr <= addr));
+  unsigned int new_class = calc_request_class(size);
+  if (large && new_class == LARGE_CLASS) {
+
+    // Yes.  Grab its length from its header.  If the new size still fits, we're
+    // done; otherwise, let mremap() handle the situation.
+    void*  old_ptr    = (void*)(addr - sizeof(size_t)); 
+    size_t old_length = *(size_t*)old_ptr;
+    size_t new_length = ROUND_TO_PAGES(size + sizeof(size_t));
+    if (new_length <= old_length) {
+      ALLOCTRACE(ALLOCTRACE_REALLOC, ptr, size, ptr);
+      return ptr;
+    }
+    void*  new_ptr    = mremap(old_ptr, old_length, new_length, MREMAP_MAYMOVE);
+    if (new_ptr == MAP_FAILED) {
+      DEBUG("realloc(): mremap() of large block failed", old_length, new_length);
+      return NULL;
+    }
+    *(size_t*)new_ptr      = new_length;
+    large_allocated_bytes += new_length - old_length;
+    large_live_bytes      += new_length - old_length;
+    void* new_block_ptr = (void*)((intptr_t)new_ptr + sizeof(size_t));
+    if (new_block_ptr != ptr) {
+      HEAPPROF_FREE(ptr);  // the sample, if any, does not follow the move
+    }
+    ALLOCTRACE(ALLOCTRACE_REALLOC, new_block_ptr, size, ptr);
+    return new_block_ptr;
+    
+  }
+  
+  // Get the current block size from its header if it is large, from its slot if
+  // it is a guarded sample, or else from its size class.
+  size_t old_size;
+  if (large) {
+    old_size = *(size_t*)(addr - sizeof(size_t)) - sizeof(size_t);
+  } else if (GUARDPOOL_OWNS(ptr)) {
+    old_size = GUARDPOOL_SIZE(ptr);
+  } else {
+    old_size = calc_class_size(GET_SIZE_CLASS(ptr));
+  }
+
+  // If the new size falls in the current size class, we're done.  A guarded
+  // sample is freed by its slot, whatever the size, and so need only fit.
+  if (GUARDPOOL_OWNS(ptr) ? size <= old_size : !large && new_class == GET_SIZE_CLASS(ptr)) {
+    ALLOCTRACE(ALLOCTRACE_REALLOC, ptr, size, ptr);
     return ptr;
   }
   
-  // Allocate the new, larger block, copy the contents of the old into it, and
-  // free the old.
+  // Allocate the new block, copy as much of the old as fits into it, and free
+  // the old.
+  ALLOCTRACE_NEST();
   void*  new_block_ptr = malloc(size);
-  size_t old_size      = 1 << size_class;
   if (new_block_ptr != NULL) {
-    memcpy(new_block_ptr, ptr, old_size);
+    memcpy(new_block_ptr, ptr, size < old_size ? size : old_size);
     free(ptr);
   }
+  ALLOCTRACE_UNNEST();
+  if (new_block_ptr != NULL) {
+    ALLOCTRACE(ALLOCTRACE_REALLOC, new_block_ptr, size, ptr);
+  }
     
   return new_block_ptr;
   
@@ -423,55 +1930,366 @@ void* realloc (void* ptr, size_t size) {
 
 
 
-#if defined (ALLOC_MAIN)
 // ==============================================================================
-#define MIN_SIZE 16
-#define MAX_SIZE 2048
+/**
+ * Allocate a block that shares no cache line with any other block.  Every size
+ * class of at least `ALLOC_CACHE_LINE` bytes is a multiple of a line, and every
+ * run starts on a page boundary, so rounding the request up to whole lines is
+ * enough; the block then comes from the usual runs, and is freed as usual.
+ * (A large block has a mapping, and so its lines, to itself anyway.)
+ *
+ * \param size The number of bytes to allocate.
+ * \return     A pointer to the allocated block, if successful; `NULL` if
+ *              unsuccessful.
+ */
+void* malloc_cacheline (size_t size) {
+
+  if (size > SIZE_MAX - (ALLOC_CACHE_LINE - 1)) {
+    return NULL;
+  }
+  return malloc((size + ALLOC_CACHE_LINE - 1) & ~(size_t)(ALLOC_CACHE_LINE - 1));
+
+} // malloc_cacheline ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Create a pool of fixed-size objects.  Objects are laid out back to back in
+ * runs that belong to the pool alone, so allocating one never computes a size
+ * class or touches another pool's or `malloc()`'s state.
+ *
+ * \param obj_size The size of each object.
+ * \param align    The alignment of each object: a power of 2 no greater than
+ *                  the page size, or 0 for the minimum block alignment.
+ * \return         The new pool, or `NULL` if the arguments are invalid or the
+ *                  heap is full.
+ */
+object_pool_s* pool_create (size_t obj_size, size_t align) {
+
+  init();
+
+  if (align == 0) {
+    align = CALC_CLASS_SIZE(MIN_SIZE_CLASS);
+  }
+  if (obj_size == 0 || (align & (align - 1)) != 0 || align > PAGE_SIZE ||
+      obj_size > MAX_MEDIUM_SIZE) {
+    DEBUG("pool_create(): Invalid object size or alignment", obj_size, align);
+    return NULL;
+  }
+
+  object_pool_s* pool = malloc(sizeof(object_pool_s));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  // Objects are placed at multiples of the stride from a page boundary, and
+  // must each be able to hold a free list link.
+  if (obj_size < sizeof(header_s)) {
+    obj_size = sizeof(header_s);
+  }
+  size_t stride = (obj_size + align - 1) & ~(align - 1);
+  size_t bytes  = stride * OBJECT_POOL_RUN_OBJECTS;
+  if (bytes > MEDIUM_RUN_BYTES) {
+    bytes = stride > MEDIUM_RUN_BYTES ? stride : MEDIUM_RUN_BYTES;
+  }
+
+  pool->stride    = stride;
+  pool->run_pages = ROUND_TO_PAGES(bytes) / PAGE_SIZE;
+  pool->free_list = NULL;
+  pool->bump      = 0;
+  pool->bump_end  = 0;
+  pool->runs      = NULL;
+  return pool;
+
+} // pool_create ()
+// ==============================================================================
+
 
+
+// ==============================================================================
 /**
- * The entry point if this code is compiled as a standalone program for testing
- * purposes.
+ * Allocate an object from a pool: the most recently freed one, or else the
+ * next never-used one in the pool's newest run, adding a run if need be.
+ *
+ * \param pool The pool.
+ * \return     A pointer to the object, if successful; `NULL` if the heap is
+ *              full.
  */
-int main (int argc, char **argv){
+void* pool_alloc (object_pool_s* pool) {
 
-  if (argc != 2) {
-    fprintf(stderr, "USAGE: %s <# alloc ops>\n", argv[0]);
-    return 1;
+  header_s* header = pool->free_list;
+  if (header != NULL) {
+    pool->free_list = header->next;
+    return header;
+  }
+
+  if (pool->bump_end - pool->bump < (intptr_t)pool->stride) {
+    page_s* run = new_pages(OBJECT_POOL_CLASS, pool->run_pages);
+    if (run == NULL) {
+      DEBUG("pool_alloc(): Failing because heap is full");
+      return NULL;
+    }
+    run->next      = pool->runs;
+    run->prev      = NULL;
+    pool->runs     = run;
+    pool->bump     = PAGE_ADDR(run);
+    pool->bump_end = pool->bump + (run->run_pages * PAGE_SIZE / pool->stride) * pool->stride;
+  }
+
+  void* object_ptr = (void*)pool->bump;
+  pool->bump      += pool->stride;
+  return object_ptr;
+
+} // pool_alloc ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Return an object to its pool.
+ *
+ * \param pool The pool from which the object was allocated.
+ * \param ptr  The object; may be `NULL`.
+ */
+void pool_free (object_pool_s* pool, void* ptr) {
+
+  if (ptr == NULL) {
+    return;
+  }
+
+#if defined (DEBUG_ALLOC)
+  intptr_t addr = (intptr_t)ptr;
+  if (addr < start_addr || end_addr <= addr || GET_SIZE_CLASS(ptr) != OBJECT_POOL_CLASS) {
+    ERROR("pool_free(): Not a pool object", addr);
+  }
+#endif
+
+  header_s* header = ptr;
+  header->next     = pool->free_list;
+  pool->free_list  = header;
+
+} // pool_free ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Destroy a pool, returning all of its runs to the page pool at once, whether
+ * or not their objects were freed.
+ *
+ * \param pool The pool.
+ */
+void pool_destroy (object_pool_s* pool) {
+
+  page_s* run = pool->runs;
+  while (run != NULL) {
+    page_s* next = run->next;
+    page_pool_release(run, run->run_pages);
+    run = next;
   }
+  free(pool);
+
+} // pool_destroy ()
+// ==============================================================================
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of one size class's statistics.  Every block of a run that is
+ * not live is free, so the free blocks follow from the class's run count.
+ *
+ * \param size_class The size class.
+ * \param stats      Where to store the snapshot.
+ */
+static void class_stats (unsigned int size_class, alloc_class_stats_s* stats) {
+
+  size_t class_size  = calc_class_size(size_class);
+  size_t run_blocks  = calc_run_blocks(size_class, class_size);
+  stats->block_size  = class_size;
+  stats->allocations = class_allocs[size_class];
+  stats->frees       = class_frees[size_class];
+  stats->runs        = class_runs[size_class];
+  stats->live_blocks = stats->allocations - stats->frees;
+  stats->free_blocks = stats->runs * run_blocks - stats->live_blocks;
+
+} // class_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the allocator's global statistics, summing the counts of
+ * its size classes and walking the page pool.
+ *
+ * \param stats Where to store the snapshot.
+ */
+void malloc_get_stats (alloc_stats_s* stats) {
 
-  int total_ops = atoi(argv[1]);
-  void** ptrs = calloc(total_ops, sizeof(void*));
-  int index = 0;
-  srandom(1);
-  int op;
-  for (op = 0; op < total_ops / 4; ++op) {
-    ptrs[index++] = malloc(random() % MAX_SIZE);
+  init();
+  memset(stats, 0, sizeof(alloc_stats_s));
+
+  for (unsigned int size_class = MIN_SIZE_CLASS; size_class <= MAX_MEDIUM_CLASS; size_class += 1) {
+    alloc_class_stats_s class;
+    class_stats(size_class, &class);
+    size_t run_bytes        = calc_run_pages(size_class) * PAGE_SIZE;
+    size_t run_blocks       = calc_run_blocks(size_class, class.block_size);
+    stats->allocations     += class.allocations;
+    stats->frees           += class.frees;
+    stats->allocated_bytes += class.allocations * class.block_size;
+    stats->live_blocks     += class.live_blocks;
+    stats->live_bytes      += class.live_blocks * class.block_size;
+    stats->free_blocks     += class.free_blocks;
+    stats->free_bytes      += class.free_blocks * class.block_size;
+    stats->overhead_bytes  += class.runs * (run_bytes - run_blocks * class.block_size);
   }
-  for (; op < total_ops / 2; ++op) {
-    int i = random() % index--;
-    free(ptrs[i]);
-    while (ptrs[i] != NULL) {
-      ptrs[i] = ptrs[i + 1];
-      ++i;
+
+  stats->allocations     += class_allocs[LARGE_CLASS];
+  stats->frees           += class_frees[LARGE_CLASS];
+  stats->requested_bytes  = requested_bytes;
+  stats->allocated_bytes += large_allocated_bytes;
+  stats->overhead_bytes  += PAGE_INDEX(free_addr) * sizeof(page_s);
+  stats->heap_bytes       = free_addr - start_addr;
+  stats->large_mappings   = class_allocs[LARGE_CLASS] - class_frees[LARGE_CLASS];
+  stats->large_bytes      = large_live_bytes;
+  stats->cached_bytes     = large_cache_bytes;
+
+  for (size_t list = 0; list < POOL_LISTS; list += 1) {
+    for (page_s* run = page_pool[list]; run != NULL; run = run->next) {
+      stats->released_bytes += run->run_pages * PAGE_SIZE;
     }
   }
 
-  // Allocate a block that's too large for the normal heap.
-  void* large = malloc(MAX_SIZE * 4);
-  free(large);
-  
-  for (; op < total_ops * 3 / 4; ++op) {
-    ptrs[index++] = malloc(random() % MAX_SIZE);
+} // malloc_get_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Take a snapshot of the statistics of each small and medium size class.
+ *
+ * \param classes Where to store the snapshots.
+ * \param n       The number of snapshots that fit at `classes`.
+ * \return        The number of size classes.
+ */
+size_t malloc_get_class_stats (alloc_class_stats_s* classes, size_t n) {
+
+  size_t count = MAX_MEDIUM_CLASS - MIN_SIZE_CLASS + 1;
+  for (size_t i = 0; i < n && i < count; i += 1) {
+    class_stats(MIN_SIZE_CLASS + i, &classes[i]);
   }
-  for (; op < total_ops; ++op) {
-    int i = random() % index--;
-    free(ptrs[i]);
-    while (ptrs[i] != NULL) {
-      ptrs[i] = ptrs[i + 1];
-      ++i;
+  return count;
+
+} // malloc_get_class_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Fill in the standard `mallinfo2` summary from the allocator's statistics.
+ *
+ * \return The summary.
+ */
+struct mallinfo2 mallinfo2 () {
+
+  alloc_stats_s stats;
+  malloc_get_stats(&stats);
+
+  struct mallinfo2 info;
+  memset(&info, 0, sizeof(info));
+  info.arena    = stats.heap_bytes;
+  info.ordblks  = stats.free_blocks;
+  info.hblks    = stats.large_mappings;
+  info.hblkhd   = stats.large_bytes;
+  info.uordblks = stats.live_bytes;
+  info.fordblks = stats.free_bytes;
+  return info;
+
+} // mallinfo2 ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Write one named statistic, on a line of its own, to `stderr`.
+ *
+ * \param name  The name of the statistic.
+ * \param value Its value.
+ */
+static void stats_line (const char* name, size_t value) {
+
+  safe_write(STDERR_FILENO, name);
+  safe_write(STDERR_FILENO, "\t");
+  safe_write_dec(STDERR_FILENO, value);
+  safe_write(STDERR_FILENO, "\n");
+
+} // stats_line ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's global statistics, followed by a table of its size
+ * classes that have ever been used, to `stderr`.  Nothing is allocated.
+ */
+void malloc_stats () {
+
+  alloc_stats_s stats;
+  malloc_get_stats(&stats);
+
+  safe_write(STDERR_FILENO, "sf-alloc statistics\n");
+  stats_line("allocations",     stats.allocations);
+  stats_line("frees",           stats.frees);
+  stats_line("requested_bytes", stats.requested_bytes);
+  stats_line("allocated_bytes", stats.allocated_bytes);
+  stats_line("live_blocks",     stats.live_blocks);
+  stats_line("live_bytes",      stats.live_bytes);
+  stats_line("free_blocks",     stats.free_blocks);
+  stats_line("free_bytes",      stats.free_bytes);
+  stats_line("overhead_bytes",  stats.overhead_bytes);
+  stats_line("heap_bytes",      stats.heap_bytes);
+  stats_line("released_bytes",  stats.released_bytes);
+  stats_line("large_mappings",  stats.large_mappings);
+  stats_line("large_bytes",     stats.large_bytes);
+  stats_line("cached_bytes",    stats.cached_bytes);
+
+  safe_write(STDERR_FILENO, "size\tallocations\tfrees\truns\tlive_blocks\tfree_blocks\n");
+  for (unsigned int size_class = MIN_SIZE_CLASS; size_class <= MAX_MEDIUM_CLASS; size_class += 1) {
+    alloc_class_stats_s class;
+    class_stats(size_class, &class);
+    if (class.allocations == 0 && class.runs == 0) {
+      continue;
+    }
+    size_t columns[] = { class.block_size, class.allocations, class.frees,
+			 class.runs, class.live_blocks, class.free_blocks };
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i += 1) {
+      safe_write_dec(STDERR_FILENO, columns[i]);
+      safe_write(STDERR_FILENO, i + 1 < sizeof(columns) / sizeof(columns[0]) ? "\t" : "\n");
     }
   }
-  
-} // main ()
+
+} // malloc_stats ()
+// ==============================================================================
+
+
+
+// ==============================================================================
+/**
+ * Print the allocator's statistics at exit, if configured to.
+ */
+static void __attribute__((destructor)) stats_at_exit () {
+
+  if (conf.stats) {
+    malloc_stats();
+  }
+
+} // stats_at_exit ()
 // ==============================================================================
-#endif